@@ -0,0 +1,164 @@
+#include "counters.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char* gCounterNames[COUNTER_MAX] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "branch_misses"
+};
+
+#ifdef __linux__
+static const uint64_t gCounterConfigs[COUNTER_MAX] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static int open_counter(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+
+    // User space only, that is what a restrictive perf_event_paranoid still allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void counters_open(Counters* counters) {
+    counters->opened = 0;
+
+    for (uint32_t i = 0; i < COUNTER_MAX; i++) {
+        counters->fds[i] = -1;
+
+#ifdef __linux__
+        counters->fds[i] = open_counter(gCounterConfigs[i]);
+        if (counters->fds[i] >= 0)
+            counters->opened |= (uint8_t)(1u << i);
+#endif
+    }
+}
+
+void counters_start(Counters* counters) {
+#ifdef __linux__
+    for (uint32_t i = 0; i < COUNTER_MAX; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void)counters;
+#endif
+}
+
+void counters_stop(Counters* counters, CounterValues* values) {
+#ifdef __linux__
+    for (uint32_t i = 0; i < COUNTER_MAX; i++) {
+        if (counters->fds[i] < 0)
+            continue;
+
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t value;
+        if (read(counters->fds[i], &value, sizeof(value)) == sizeof(value)) {
+            values->values[i] += value;
+            values->valid |= (uint8_t)(1u << i);
+        }
+    }
+#else
+    (void)counters;
+    (void)values;
+#endif
+}
+
+void counters_close(Counters* counters) {
+#ifndef _WIN32
+    for (uint32_t i = 0; i < COUNTER_MAX; i++) {
+        if (counters->fds[i] >= 0)
+            close(counters->fds[i]);
+
+        counters->fds[i] = -1;
+    }
+#endif
+
+    counters->opened = 0;
+}
+
+const char* get_counter_name(CounterType type) {
+    return type < COUNTER_MAX ? gCounterNames[type] : "???";
+}
+
+double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+// The linker sends every allocation of the library through these, see kasm_bench in CMakeLists.txt
+static uint64_t gAllocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    gAllocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    gAllocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    gAllocations++;
+    return __real_realloc(pointer, size);
+}
+
+uint64_t bench_allocations(void) {
+    return gAllocations;
+}
+
+uint8_t bench_counts_allocations(void) {
+    return 1;
+}
+#else
+uint64_t bench_allocations(void) {
+    return 0;
+}
+
+uint8_t bench_counts_allocations(void) {
+    return 0;
+}
+#endif
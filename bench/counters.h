@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_MAX
+} CounterType;
+
+// Hardware counters of the calling thread, read through perf_event_open on linux
+// Counters the kernel or the machine won't give us are left out, without any the values just aren't there
+typedef struct {
+    int fds[COUNTER_MAX];
+    uint8_t opened;
+} Counters;
+
+typedef struct {
+    uint64_t values[COUNTER_MAX];
+
+    // Bit per CounterType that was actually counted
+    uint8_t valid;
+} CounterValues;
+
+void counters_open(Counters* counters);
+void counters_start(Counters* counters);
+
+// Adds what was counted since counters_start to values
+void counters_stop(Counters* counters, CounterValues* values);
+void counters_close(Counters* counters);
+
+const char* get_counter_name(CounterType type);
+
+// Monotonic wall clock in seconds
+double bench_now(void);
+
+// Allocations made through malloc, calloc and realloc so far, 0 when they aren't being counted
+uint64_t bench_allocations(void);
+uint8_t bench_counts_allocations(void);
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/libkasm.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "workloads.h"
+#include "counters.h"
+
+#ifdef _WIN32
+#  include "getopt.h"
+#else
+#  include <getopt.h>
+#endif
+
+// Compiled in from targets/km8, the benchmark doesn't go through dlopen
+BuildTarget* kasm_target_register();
+
+typedef enum {
+    STAGE_LEX,
+    STAGE_PARSE,
+    STAGE_BUILD_BUFFER,
+    STAGE_BUILD,
+    STAGE_BUILD_STREAM,
+    STAGE_MAX
+} StageType;
+
+static const char* gStageNames[STAGE_MAX] = {
+    "lex",
+    "parse",
+    "build_buffer",
+    "build",
+    "build_stream"
+};
+
+typedef struct {
+    uint8_t failed;
+    uint32_t iterations;
+
+    // Throughput comes from the fastest iteration, the per line numbers are averaged over all of them
+    double best;
+    double total;
+
+    uint64_t allocations;
+    CounterValues counters;
+} StageResult;
+
+typedef struct {
+    BuildTarget* target;
+    Workload* workload;
+
+    BuildContext context;
+    TokenStream tokens;
+
+    // kasm_build needs the source on disk
+    char sourcePath[512];
+    char outputPath[512];
+
+    double minTime;
+    Counters counters;
+} Bench;
+
+static uint8_t run_stage(Bench* bench, StageType stage) {
+    const char* source = (const char*)bench->workload->source.data;
+    uint32_t length = bench->workload->source.length;
+    BuildContext* context = &bench->context;
+
+    switch (stage) {
+        case STAGE_LEX:
+            token_stream_clear(&bench->tokens);
+            return lex(source, length, &bench->tokens) != LEXER_OK;
+
+        // The tokens were lexed into the context up front, only the parse itself is timed
+        case STAGE_PARSE:
+            context->freeFixups = NULL;
+            arena_reset(&context->arena);
+            return kasm_parse(context) != PARSER_OK;
+
+        case STAGE_BUILD_BUFFER:
+            context->flags = 0;
+            return kasm_build_buffer(source, length, context);
+
+        case STAGE_BUILD:
+            context->flags = 0;
+            return kasm_build(bench->sourcePath, bench->outputPath, context);
+
+        case STAGE_BUILD_STREAM:
+            context->flags = BUILD_FLAG_STREAM;
+            return kasm_build(bench->sourcePath, bench->outputPath, context);
+
+        default:
+            return 1;
+    }
+}
+
+static uint8_t prepare_stage(Bench* bench, StageType stage) {
+    if (stage != STAGE_PARSE)
+        return 0;
+
+    BuildContext* context = &bench->context;
+    kasm_context_reset(context);
+    context->flags = 0;
+
+    if (context->tokens.types == NULL && token_stream_init(&context->tokens) != TOKEN_STREAM_OK)
+        return 1;
+
+    return lex((const char*)bench->workload->source.data, bench->workload->source.length, &context->tokens) != LEXER_OK;
+}
+
+static void measure_stage(Bench* bench, StageType stage, StageResult* result) {
+    memset(result, 0, sizeof(StageResult));
+
+    // One run to warm up the caches and grow every buffer, it also tells us if the workload builds at all
+    if (prepare_stage(bench, stage) || run_stage(bench, stage)) {
+        result->failed = 1;
+        return;
+    }
+
+    uint64_t allocations = bench_allocations();
+
+    while (result->iterations < 3 || result->total < bench->minTime) {
+        double start = bench_now();
+        counters_start(&bench->counters);
+
+        uint8_t failed = run_stage(bench, stage);
+
+        counters_stop(&bench->counters, &result->counters);
+        double elapsed = bench_now() - start;
+
+        if (failed) {
+            result->failed = 1;
+            return;
+        }
+
+        if (result->iterations == 0 || elapsed < result->best)
+            result->best = elapsed;
+
+        result->total += elapsed;
+        result->iterations++;
+    }
+
+    result->allocations = bench_allocations() - allocations;
+}
+
+static uint8_t write_source(Bench* bench) {
+    FILE* file = fopen(bench->sourcePath, "wb");
+    if (file == NULL)
+        return 1;
+
+    size_t length = bench->workload->source.length;
+    uint8_t failed = fwrite(bench->workload->source.data, 1, length, file) != length;
+
+    return (uint8_t)(fclose(file) != 0 || failed);
+}
+
+static void print_stage(FILE* out, const Workload* workload, StageType stage, const StageResult* result, uint8_t last) {
+    fprintf(out, "        {\n          \"name\": \"%s\",\n", gStageNames[stage]);
+
+    if (result->failed) {
+        fprintf(out, "          \"failed\": true\n        }%s\n", last ? "" : ",");
+        return;
+    }
+
+    double lines = (double)workload->lines * result->iterations;
+
+    fprintf(out, "          \"iterations\": %u,\n", result->iterations);
+    fprintf(out, "          \"best_seconds\": %.9f,\n", result->best);
+    fprintf(out, "          \"mean_seconds\": %.9f,\n", result->total / result->iterations);
+    fprintf(out, "          \"mb_per_second\": %.3f,\n", (double)workload->source.length / result->best / 1e6);
+    fprintf(out, "          \"lines_per_second\": %.0f,\n", (double)workload->lines / result->best);
+    fprintf(out, "          \"ns_per_line\": %.3f,\n", result->total * 1e9 / lines);
+
+    if (bench_counts_allocations())
+        fprintf(out, "          \"allocations_per_line\": %.6f", (double)result->allocations / lines);
+    else
+        fprintf(out, "          \"allocations_per_line\": null");
+
+    for (uint32_t i = 0; i < COUNTER_MAX; i++) {
+        if (result->counters.valid & (1u << i))
+            fprintf(out, ",\n          \"%s_per_line\": %.3f", get_counter_name((CounterType)i), (double)result->counters.values[i] / lines);
+        else
+            fprintf(out, ",\n          \"%s_per_line\": null", get_counter_name((CounterType)i));
+    }
+
+    fprintf(out, "\n        }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    uint32_t size = 4;
+    double minTime = 0.5;
+    const char* outputPath = NULL;
+    const char* directory = ".";
+    uint32_t workloads = (1u << WORKLOAD_MAX) - 1;
+
+    while ((opt = getopt(argc, argv, "s:t:w:o:d:h")) != -1) {
+        switch (opt) {
+            case 's': // Megabytes of source per workload
+                size = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 't': // Least time spent on every stage
+                minTime = strtod(optarg, NULL);
+                break;
+
+            case 'w': { // Only run these, may be given more than once
+                WorkloadType type;
+                if (parse_workload_type(optarg, &type)) {
+                    printf("Unknown workload: %s\n", optarg);
+                    return 1;
+                }
+
+                if (workloads == (1u << WORKLOAD_MAX) - 1)
+                    workloads = 0;
+
+                workloads |= 1u << type;
+                break;
+            }
+
+            case 'o': // JSON goes here instead of stdout
+                outputPath = optarg;
+                break;
+
+            case 'd': // Where the source and output files for kasm_build go
+                directory = optarg;
+                break;
+
+            case 'h':
+                printf("Usage: kasm_bench [-s <megabytes>] [-t <seconds>] [-w <workload> ...] [-o <json>] [-d <directory>]\n");
+                printf("Workloads:");
+                for (uint32_t i = 0; i < WORKLOAD_MAX; i++)
+                    printf(" %s", get_workload_name((WorkloadType)i));
+                printf("\n");
+                return 0;
+
+            default:
+                return 1;
+        }
+    }
+
+    if (size == 0 || size > 1024) {
+        printf("Size has to be between 1 and 1024 megabytes\n");
+        return 1;
+    }
+
+    Bench bench = { 0 };
+    bench.minTime = minTime;
+    bench.target = kasm_target_register();
+    snprintf(bench.sourcePath, sizeof(bench.sourcePath), "%s/kasm_bench.kasm", directory);
+    snprintf(bench.outputPath, sizeof(bench.outputPath), "%s/kasm_bench.bin", directory);
+
+    if (kasm_register_target(bench.target) > TARGET_SIGNATURE_CONFLICT) {
+        printf("Could not register the km8 target\n");
+        return 1;
+    }
+
+    bench.context.target = bench.target;
+
+    if (token_stream_init(&bench.tokens) != TOKEN_STREAM_OK) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    FILE* out = outputPath != NULL ? fopen(outputPath, "w") : stdout;
+    if (out == NULL) {
+        printf("Could not open %s\n", outputPath);
+        return 1;
+    }
+
+    counters_open(&bench.counters);
+
+    fprintf(out, "{\n  \"target\": \"%s\",\n  \"target_version\": \"%s\",\n", bench.target->name, bench.target->version);
+    fprintf(out, "  \"allocations_counted\": %s,\n", bench_counts_allocations() ? "true" : "false");
+    fprintf(out, "  \"workloads\": [\n");
+
+    uint8_t first = 1;
+    int status = 0;
+
+    for (uint32_t type = 0; type < WORKLOAD_MAX; type++) {
+        if (!(workloads & (1u << type)))
+            continue;
+
+        Workload workload;
+        if (workload_generate(&workload, (WorkloadType)type, size * 1024 * 1024)) {
+            printf("Could not generate %s\n", get_workload_name((WorkloadType)type));
+            workload_dispose(&workload);
+            status = 1;
+            continue;
+        }
+
+        bench.workload = &workload;
+
+        if (write_source(&bench)) {
+            printf("Could not write %s\n", bench.sourcePath);
+            workload_dispose(&workload);
+            status = 1;
+            break;
+        }
+
+        fprintf(out, "%s    {\n      \"name\": \"%s\",\n", first ? "" : ",\n", get_workload_name((WorkloadType)type));
+        fprintf(out, "      \"bytes\": %u,\n      \"lines\": %u,\n      \"stages\": [\n", workload.source.length, workload.lines);
+        first = 0;
+
+        for (uint32_t stage = 0; stage < STAGE_MAX; stage++) {
+            StageResult result;
+            measure_stage(&bench, (StageType)stage, &result);
+
+            // Progress goes to stderr so stdout stays valid JSON
+            if (result.failed) {
+                fprintf(stderr, "%-12s %-12s failed\n", get_workload_name((WorkloadType)type), gStageNames[stage]);
+                status = 1;
+            }
+            else {
+                fprintf(stderr, "%-12s %-12s %9.2f MB/s %12.0f lines/s\n", get_workload_name((WorkloadType)type), gStageNames[stage],
+                    (double)workload.source.length / result.best / 1e6, (double)workload.lines / result.best);
+            }
+
+            print_stage(out, &workload, (StageType)stage, &result, stage + 1 == STAGE_MAX);
+        }
+
+        fprintf(out, "      ]\n    }");
+        workload_dispose(&workload);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    counters_close(&bench.counters);
+    token_stream_dispose(&bench.tokens);
+    kasm_context_dispose(&bench.context);
+    kasm_unregister_target(bench.target);
+
+    remove(bench.sourcePath);
+    remove(bench.outputPath);
+    return status;
+}
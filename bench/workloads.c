@@ -0,0 +1,195 @@
+#include "workloads.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// km8 addresses are 16 bit, a new bank starts well before the current one runs out
+#define WORKLOAD_BANK_LIMIT 60000
+
+static const char* gWorkloadNames[WORKLOAD_MAX] = {
+    "instructions",
+    "labels",
+    "data",
+    "comments",
+    "long_tokens"
+};
+
+// Small xorshift, rand() differs between platforms and the sources shouldn't
+static uint32_t next_random(Workload* workload) {
+    uint32_t x = workload->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    workload->seed = x;
+    return x;
+}
+
+static uint8_t append_args(Workload* workload, const char* format, va_list args) {
+    char line[1024];
+    int length = vsnprintf(line, sizeof(line), format, args);
+
+    if (length < 0 || length >= (int)sizeof(line))
+        return 1;
+
+    return byte_buffer_write(&workload->source, workload->source.length, line, (uint32_t)length) != BYTE_BUFFER_OK;
+}
+
+static uint8_t append(Workload* workload, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    uint8_t failed = append_args(workload, format, args);
+    va_end(args);
+
+    return failed;
+}
+
+// Every line goes through here, size is the most bytes the line can encode to
+static uint8_t emit_line(Workload* workload, uint32_t size, const char* format, ...) {
+    if (workload->bankBytes + size > WORKLOAD_BANK_LIMIT) {
+        workload->bank++;
+        workload->bankBytes = 0;
+
+        if (append(workload, ".bank $0x%X\n.org $0x0\n", workload->bank))
+            return 1;
+
+        workload->lines += 2;
+    }
+
+    va_list args;
+    va_start(args, format);
+    uint8_t failed = append_args(workload, format, args);
+    va_end(args);
+
+    workload->bankBytes += size;
+    workload->lines++;
+
+    return failed;
+}
+
+// Straight line code with a mix of every operand type
+static uint8_t generate_instruction(Workload* workload) {
+    uint32_t value = next_random(workload);
+    uint32_t a = value % 12;
+    uint32_t b = (value >> 4) % 12;
+    uint32_t immediate = (value >> 8) & 0xFF;
+
+    switch ((value >> 16) % 8) {
+        case 0:  return emit_line(workload, 3, "ldr r%u, #%u\n", a, immediate);
+        case 1:  return emit_line(workload, 4, "ldr r%u, $0x%04X\n", a, (value >> 8) & 0xFFFF);
+        case 2:  return emit_line(workload, 3, "add r%u, r%u\n", a, b);
+        case 3:  return emit_line(workload, 3, "sub r%u, #0x%02X\n", a, immediate);
+        case 4:  return emit_line(workload, 3, "mov r%u, r%u\n", a, b);
+        case 5:  return emit_line(workload, 2, "push r%u\n", a);
+        case 6:  return emit_line(workload, 3, "cmp r%u, #%u\n", a, immediate);
+        default: return emit_line(workload, 4, "str r%u, $0x%04X\n", a, (value >> 8) & 0xFFFF);
+    }
+}
+
+// A label every couple of lines and jumps to labels both behind and ahead, forward ones need fixups
+static uint8_t generate_labels(Workload* workload, uint32_t index) {
+    if (index % 2 == 0)
+        return emit_line(workload, 0, "@label_%u:\n", index / 2);
+
+    uint32_t value = next_random(workload);
+    uint32_t current = index / 2;
+    uint32_t target = (value & 1) ? current + 1 + (value >> 1) % 16 : current - (current ? (value >> 1) % (current < 16 ? current : 16) : 0);
+
+    switch ((value >> 8) % 3) {
+        case 0:  return emit_line(workload, 3, "jmp @label_%u\n", target);
+        case 1:  return emit_line(workload, 3, "jz @label_%u\n", target);
+        default: return emit_line(workload, 3, "jnz @label_%u\n", target);
+    }
+}
+
+// Lookup tables, lots of small values on one line
+static uint8_t generate_data(Workload* workload) {
+    char line[512];
+    int length = snprintf(line, sizeof(line), ".db");
+
+    for (uint32_t i = 0; i < 32; i++) {
+        length += snprintf(&line[length], sizeof(line) - (size_t)length, i ? ", #0x%02X" : " #0x%02X", next_random(workload) & 0xFF);
+    }
+
+    return emit_line(workload, 32, "%s\n", line);
+}
+
+// Commented out blocks and code with a note after every instruction
+static uint8_t generate_comment(Workload* workload, uint32_t index) {
+    uint32_t value = next_random(workload);
+
+    if (index % 4 == 0)
+        return emit_line(workload, 0, "; ---- block %u: restores the registers the caller expects to survive, see the notes below ----\n", index / 4);
+
+    if (index % 4 == 1)
+        return emit_line(workload, 0, "\t\t; %08X %08X %08X nothing in here is code, the scanner should skip it in one go\n", value, value * 31, value * 131);
+
+    return emit_line(workload, 3, "\tadd r%u, #%u\t\t; bump the counter by a small constant and carry on\n", value % 12, (value >> 8) & 0xFF);
+}
+
+// Very long label names and immediates padded with leading zeroes
+static uint8_t generate_long_tokens(Workload* workload, uint32_t index) {
+    static const char* padding = "the_quick_brown_fox_jumps_over_the_lazy_dog_and_keeps_running_through_the_whole_field_until_sunset";
+    uint32_t value = next_random(workload);
+
+    if (index % 3 == 0)
+        return emit_line(workload, 0, "@%s_%s_%u:\n", padding, padding, index / 3);
+
+    if (index % 3 == 1)
+        return emit_line(workload, 3, "ldr r%u, #0x00000000000000000000000000%02X\n", value % 12, (value >> 8) & 0xFF);
+
+    return emit_line(workload, 3, "jmp @%s_%s_%u\n", padding, padding, index / 3);
+}
+
+uint8_t workload_generate(Workload* workload, WorkloadType type, uint32_t size) {
+    memset(workload, 0, sizeof(Workload));
+    workload->seed = 0x9E3779B9u ^ (uint32_t)type;
+
+    if (byte_buffer_reserve(&workload->source, size + 1024) != BYTE_BUFFER_OK)
+        return 1;
+
+    uint32_t i = 0;
+    for (; workload->source.length < size; i++) {
+        uint8_t failed;
+
+        switch (type) {
+            case WORKLOAD_INSTRUCTIONS: failed = generate_instruction(workload); break;
+            case WORKLOAD_LABELS:       failed = generate_labels(workload, i); break;
+            case WORKLOAD_DATA:         failed = generate_data(workload); break;
+            case WORKLOAD_COMMENTS:     failed = generate_comment(workload, i); break;
+            case WORKLOAD_LONG_TOKENS:  failed = generate_long_tokens(workload, i); break;
+            default:                    return 1;
+        }
+
+        if (failed)
+            return 1;
+    }
+
+    // Jumps reach up to 16 labels ahead, so the ones past the end still have to be defined
+    if (type == WORKLOAD_LABELS) {
+        for (uint32_t j = 0; j <= 16; j++) {
+            if (emit_line(workload, 0, "@label_%u:\n", (i + 1) / 2 + j))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+void workload_dispose(Workload* workload) {
+    byte_buffer_dispose(&workload->source);
+}
+
+const char* get_workload_name(WorkloadType type) {
+    return type < WORKLOAD_MAX ? gWorkloadNames[type] : "???";
+}
+
+uint8_t parse_workload_type(const char* name, WorkloadType* type) {
+    for (uint32_t i = 0; i < WORKLOAD_MAX; i++) {
+        if (strcmp(name, gWorkloadNames[i]) == 0) {
+            *type = (WorkloadType)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
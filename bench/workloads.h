@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include "../src/buffer.h"
+
+// Synthetic km8 sources, each one stresses a different part of the pipeline
+typedef enum {
+    WORKLOAD_INSTRUCTIONS,
+    WORKLOAD_LABELS,
+    WORKLOAD_DATA,
+    WORKLOAD_COMMENTS,
+    WORKLOAD_LONG_TOKENS,
+    WORKLOAD_MAX
+} WorkloadType;
+
+typedef struct {
+    ByteBuffer source;
+    uint32_t lines;
+
+    // Code moves to the next bank before a bank fills up, so any size assembles
+    uint32_t bank;
+    uint32_t bankBytes;
+
+    // Same seed, same source, so runs can be compared
+    uint32_t seed;
+} Workload;
+
+// Generates about size bytes of source, always ending on a new line
+uint8_t workload_generate(Workload* workload, WorkloadType type, uint32_t size);
+void workload_dispose(Workload* workload);
+
+const char* get_workload_name(WorkloadType type);
+uint8_t parse_workload_type(const char* name, WorkloadType* type);
@@ -1,7 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../src/libkasm.h"
 #include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/assembler.h"
+#include "../src/object.h"
+#include "../src/include.h"
+#include "../src/thread.h"
+#include "serve.h"
 
 #ifdef _WIN32
 #  include "getopt.h"
@@ -14,8 +21,11 @@
 #ifdef _WIN32
 #include <windows.h>
 #define DLLSYM __declspec(dllimport)
+#define TARGET_EXTENSION "dll"
 #else
+#include <dlfcn.h>
 #define DLLSYM
+#define TARGET_EXTENSION "so"
 #endif
 
 typedef BuildTarget* (*TargetRegisterFn)();
@@ -24,29 +34,422 @@ BuildTarget* load_target_register(const char* path) {
     TargetRegisterFn reg;
 #ifdef _WIN32
     HMODULE lib = LoadLibraryA(path);
+    if (lib == NULL)
+        return NULL;
+
     reg = (TargetRegisterFn)GetProcAddress(lib, "kasm_target_register");
 #else
     void* lib = dlopen(path, RTLD_NOW);
+    if (lib == NULL)
+        return NULL;
+
     reg = (TargetRegisterFn)dlsym(lib, "kasm_target_register");
 #endif
 
-    return reg();
+    if (reg == NULL)
+        return NULL;
+
+    // Build the lookup tables once, up front
+    BuildTarget* target = reg();
+    if (target == NULL)
+        return NULL;
+
+    TargetResult result = kasm_register_target(target);
+    if (result > TARGET_SIGNATURE_CONFLICT) {
+        printf("Could not register target: %s\n", get_target_result_msg(result));
+        return NULL;
+    }
+
+    // Duplicate encodings are only a warning, the first one keeps working
+    const OpcodeConflict* conflicts;
+    uint16_t conflictCount = kasm_get_target_conflicts(target, &conflicts);
+
+    for (uint16_t i = 0; i < conflictCount; i++) {
+        const OpcodeDef* opcode = target->get_opcode(conflicts[i].second);
+        printf("Warning: opcode 0x%02X (%s) has the same operands as 0x%02X and can never be selected\n",
+            conflicts[i].second, opcode->mnemonic, conflicts[i].first);
+    }
+
+    return target;
+}
+
+// A single input of a batch, the diagnostics are kept until every job is done so they print in order
+typedef struct {
+    const char* input;
+    char* output;
+
+    // Manifest inputs are copies, -f inputs point into argv
+    uint8_t ownsInput;
+
+    uint8_t failed;
+    char message[256];
+
+    // Only filled in with -s
+    BuildStats stats;
+} Job;
+
+typedef struct {
+    BuildTarget* target;
+
+    // Added to the flags of every build, like BUILD_FLAG_SPLIT_BANKS
+    uint8_t flags;
+
+    // Every job records its BuildStats
+    uint8_t stats;
+
+    Job* jobs;
+    uint32_t jobCount;
+
+    // Shared by every worker, a header the whole batch includes gets lexed once
+    IncludeCache includes;
+
+    // Workers take the next job from here
+    uint32_t nextJob;
+    Mutex lock;
+} JobQueue;
+
+// Formats the most specific reason we have for a failed build
+void format_build_error(const BuildContext* context, char* message, size_t size) {
+    const char* reason = NULL;
+
+    switch (context->assemblerResult) {
+        case BUILD_RESULT_SYNTAX_ERROR:
+            // A rejected line means the parser stopped the lexer, so the parser has the reason
+            if (context->tokenizerResult != LEXER_OK && context->tokenizerResult != LEXER_LINE_REJECTED)
+                reason = get_lexer_result_msg(context->tokenizerResult);
+            else
+                reason = get_parser_result_msg(context->parserResult);
+            break;
+
+        case BUILD_RESULT_ASSEMBLY_ERROR:
+            reason = get_assembler_result_msg(context->assemblyResult);
+            break;
+
+        default:
+            break;
+    }
+
+    if (reason != NULL)
+        snprintf(message, size, "%s (%s) on line %u", get_build_result_msg(context->assemblerResult), reason, context->errorLine + 1);
+    else
+        snprintf(message, size, "%s", get_build_result_msg(context->assemblerResult));
+}
+
+static void run_job(BuildContext* context, Job* job, uint8_t flags, uint8_t stats) {
+    // Streaming keeps memory flat no matter how big the source is
+    context->flags = BUILD_FLAG_STREAM | flags;
+    context->stats = stats ? &job->stats : NULL;
+
+    job->failed = kasm_build(job->input, job->output, context);
+    if (job->failed)
+        format_build_error(context, job->message, sizeof(job->message));
+    else
+        snprintf(job->message, sizeof(job->message), "Wrote %llu bytes to %s", (unsigned long long)image_written_size(&context->image), job->output);
+}
+
+// Every worker keeps one context for all the jobs it picks up, so its arena and buffers get reused
+static void worker_main(void* user) {
+    JobQueue* queue = user;
+
+    BuildContext context = { 0 };
+    context.target = queue->target;
+    context.includes = &queue->includes;
+
+    for (;;) {
+        mutex_lock(&queue->lock);
+        uint32_t index = queue->nextJob++;
+        mutex_unlock(&queue->lock);
+
+        if (index >= queue->jobCount)
+            break;
+
+        run_job(&context, &queue->jobs[index], queue->flags, queue->stats);
+    }
+
+    kasm_context_dispose(&context);
+}
+
+static uint8_t add_job(Job** jobs, uint32_t* count, uint32_t* capacity, const char* input, char* output) {
+    if (*count >= *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 16;
+        Job* resized = realloc(*jobs, sizeof(Job) * grown);
+        if (resized == NULL)
+            return 1;
+
+        *jobs = resized;
+        *capacity = grown;
+    }
+
+    Job* job = &(*jobs)[(*count)++];
+    memset(job, 0, sizeof(Job));
+    job->input = input;
+    job->output = output;
+
+    return 0;
+}
+
+static char* copy_string(const char* value, size_t length) {
+    char* copy = malloc(length + 1);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Batch outputs go next to their input, "rom/bank0.kasm" becomes "rom/bank0.bin" or "rom/bank0.o" for an object
+static char* default_output_path(const char* input, const char* extension) {
+    const char* dot = strrchr(input, '.');
+    const char* slash = strrchr(input, '/');
+    const char* backslash = strrchr(input, '\\');
+    if (backslash > slash)
+        slash = backslash;
+
+    size_t stem = (dot != NULL && (slash == NULL || dot > slash)) ? (size_t)(dot - input) : strlen(input);
+
+    size_t extensionLength = strlen(extension);
+
+    char* output = malloc(stem + extensionLength + 1);
+    if (output == NULL)
+        return NULL;
+
+    memcpy(output, input, stem);
+    memcpy(&output[stem], extension, extensionLength + 1);
+    return output;
+}
+
+// Every line of a manifest is "input [output]", empty lines and lines starting with '#' are skipped
+static uint8_t read_manifest(const char* path, const char* extension, Job** jobs, uint32_t* count, uint32_t* capacity) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Could not open manifest: %s\n", path);
+        return 1;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* input = strtok(line, " \t\r\n");
+        if (input == NULL || input[0] == '#')
+            continue;
+
+        char* output = strtok(NULL, " \t\r\n");
+
+        char* inputCopy = copy_string(input, strlen(input));
+        char* outputCopy = output != NULL ? copy_string(output, strlen(output)) : default_output_path(input, extension);
+
+        if (inputCopy == NULL || outputCopy == NULL || add_job(jobs, count, capacity, inputCopy, outputCopy)) {
+            free(inputCopy);
+            free(outputCopy);
+            fclose(file);
+            printf("Out of memory while reading the manifest\n");
+            return 1;
+        }
+
+        (*jobs)[*count - 1].ownsInput = 1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static void print_size(const char* label, uint64_t bytes) {
+    if (bytes >= 1024 * 1024)
+        printf("%s%.2f MB", label, bytes / (1024.0 * 1024.0));
+    else if (bytes >= 1024)
+        printf("%s%.2f KB", label, bytes / 1024.0);
+    else
+        printf("%s%llu B", label, (unsigned long long)bytes);
+}
+
+static void print_stats(const BuildStats* stats) {
+    for (uint32_t i = 0; i < BUILD_STATE_MAX; i++) {
+        printf("    %-14s %10.3f ms wall %10.3f ms cpu\n", get_build_state_name((BuildState)i), stats->wallTime[i] * 1e3, stats->cpuTime[i] * 1e3);
+    }
+
+    printf("    %-14s %10.3f ms wall %10.3f ms cpu\n", "Total", stats->totalWallTime * 1e3, stats->totalCpuTime * 1e3);
+    printf("    %u lines, %llu tokens, %u actions, %u labels\n", stats->lines, (unsigned long long)stats->tokens, stats->actions, stats->labels);
+
+    print_size("    ", stats->sourceSize);
+    print_size(" source, ", stats->outputSize);
+    print_size(" output, ", stats->peakMemory);
+    print_size(" peak memory, ", stats->allocatedBytes);
+    printf(" allocated\n");
+}
+
+// Builds every job in this process, spread over threadCount workers
+static int run_local(const char* targetPath, uint8_t flags, uint8_t stats, Job* jobs, uint32_t jobCount, uint32_t threadCount) {
+    // Loaded once, after registering it is only ever read
+    printf("Loading target: %s\n", targetPath);
+    BuildTarget* target = load_target_register(targetPath);
+
+    if(target == NULL) {
+        printf("Could not load target!\n");
+        return 1;
+    }
+
+    if (threadCount == 0)
+        threadCount = thread_cpu_count();
+
+    if (threadCount > jobCount)
+        threadCount = jobCount;
+
+    JobQueue queue = { 0 };
+    queue.target = target;
+    queue.flags = flags;
+    queue.stats = stats;
+    queue.jobs = jobs;
+    queue.jobCount = jobCount;
+    mutex_init(&queue.lock);
+    include_cache_init(&queue.includes);
+
+    // The calling thread is a worker too, a single job never starts a thread
+    Thread* threads = calloc(threadCount, sizeof(Thread));
+    uint32_t started = 0;
+
+    if (threads != NULL) {
+        for (; started + 1 < threadCount; started++) {
+            if (thread_create(&threads[started], worker_main, &queue) != THREAD_OK)
+                break;
+        }
+    }
+
+    worker_main(&queue);
+
+    for (uint32_t i = 0; i < started; i++)
+        thread_join(&threads[i]);
+
+    free(threads);
+    mutex_dispose(&queue.lock);
+    include_cache_dispose(&queue.includes);
+
+    return 0;
+}
+
+// Links every input into one output, the objects go in in the order they were given
+static int run_link(const char* targetPath, uint8_t flags, uint8_t stats, const char** inputs, uint32_t inputCount, const char* output) {
+    printf("Loading target: %s\n", targetPath);
+    BuildTarget* target = load_target_register(targetPath);
+
+    if(target == NULL) {
+        printf("Could not load target!\n");
+        return 1;
+    }
+
+    BuildStats buildStats;
+    BuildContext context = { 0 };
+    context.target = target;
+    context.flags = flags;
+    context.stats = stats ? &buildStats : NULL;
+
+    uint8_t failed = kasm_link(inputs, inputCount, output, &context);
+
+    // A failure past the last object is about the output, or a label none of them define
+    const char* where = context.errorObject < inputCount ? inputs[context.errorObject] : output;
+
+    if (!failed)
+        printf("%s: Linked %u objects, wrote %llu bytes\n", output, inputCount, (unsigned long long)image_written_size(&context.image));
+    else if (context.assemblerResult == BUILD_RESULT_LINK_ERROR)
+        printf("%s: %s (%s)\n", where, get_build_result_msg(context.assemblerResult), get_object_result_msg(context.linkerResult));
+    else
+        printf("%s: %s\n", where, get_build_result_msg(context.assemblerResult));
+
+    if (stats)
+        print_stats(&buildStats);
+
+    kasm_context_dispose(&context);
+    return failed;
+}
+
+// Hands every job to the server on path, the target is loaded over there and stays loaded
+static int run_remote(const char* path, const char* target, uint8_t flags, Job* jobs, uint32_t jobCount) {
+    if (flags & BUILD_FLAG_SPLIT_BANKS) {
+        printf("-b doesn't work with -C, the server sends the image back flat\n");
+        return 1;
+    }
+
+    int connection = kasm_connect(path);
+    if (connection < 0) {
+        printf("Could not connect to %s\n", path);
+        return 1;
+    }
+
+    // One connection for the whole batch, the server keeps its context warm between requests
+    for (uint32_t i = 0; i < jobCount; i++) {
+        Job* job = &jobs[i];
+        job->failed = (uint8_t)kasm_remote_build(connection, target, BUILD_FLAG_STREAM | flags, job->input, job->output, job->message, sizeof(job->message));
+    }
+
+    kasm_disconnect(connection);
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     int opt;
-    char* file_path = NULL;
+    char* output_path = NULL;
+    char* manifest_path = NULL;
+    char* serve_path = NULL;
+    char* connect_path = NULL;
     char* target_name = NULL;
     char targetPath[256] = {0};
+    uint32_t threadCount = 0;
+    uint8_t flags = 0;
+    uint8_t stats = 0;
+    uint8_t link = 0;
 
-    while ((opt = getopt(argc, argv, "f:V:t:h")) != -1) {
+    // Every -f is kept, a single one behaves like before
+    const char** inputs = calloc((size_t)argc, sizeof(char*));
+    uint32_t inputCount = 0;
+
+    if (inputs == NULL)
+        return 1;
+
+    while ((opt = getopt(argc, argv, "f:o:m:j:bcslS:C:V:t:h")) != -1) {
         switch (opt) {
-            case 'f': // File select
-                file_path = optarg;
+            case 'f': // File select, may be given more than once
+                inputs[inputCount++] = optarg;
+                break;
+
+            case 'o': // Output file
+                output_path = optarg;
+                break;
+
+            case 'm': // Manifest with one input per line
+                manifest_path = optarg;
+                break;
+
+            case 'j': // Worker threads, defaults to the core count
+                threadCount = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'b': // One output file per bank
+                flags |= BUILD_FLAG_SPLIT_BANKS;
+                break;
+
+            case 'c': // Assemble to objects instead of images
+                flags |= BUILD_FLAG_OBJECT;
+                break;
+
+            case 'l': // Link the inputs, they are objects
+                link = 1;
+                break;
+
+            case 's': // Time and memory per build
+                stats = 1;
+                break;
+
+            case 'S': // Serve builds on a local socket
+                serve_path = optarg;
+                break;
+
+            case 'C': // Build through a server instead of in this process
+                connect_path = optarg;
                 break;
 
             case 'h': // Help
-                printf("Usage: kasm -f <file>\n");
+                printf("Usage: kasm -t <target> -f <file> [-f <file> ...] [-m <manifest>] [-o <output>] [-j <threads>] [-b] [-c] [-s] [-C <socket>]\n");
+                printf("       kasm -t <target> -l -f <object> [-f <object> ...] [-o <output>] [-b] [-c] [-s]\n");
+                printf("       kasm -S <socket> [-j <threads>]\n");
                 return 0;
 
             case 'V': // Print Version
@@ -55,53 +458,98 @@ int main(int argc, char *argv[]) {
 
             case 't': // Target
                 target_name = optarg;
-                snprintf(targetPath, sizeof(targetPath), "targets/%s.dll", target_name);
+                snprintf(targetPath, sizeof(targetPath), "targets/%s." TARGET_EXTENSION, target_name);
                 break;
             default:
                 return 1;
         }
     }
 
-    if(file_path == NULL) {
-        printf("No file specified.\n");
-        return 1;
-    }
+    // The server loads targets as requests name them
+    if (serve_path != NULL)
+        return kasm_serve(serve_path, threadCount);
 
     if(target_name == NULL) {
         printf("No target specified.\n");
         return 1;
     }
-    
-    printf("Loading target: %s\n", targetPath);
-    BuildTarget* target = load_target_register(targetPath);
 
-    if(target == NULL) {
-        printf("Could not load target!\n");
+    const char* extension = (flags & BUILD_FLAG_OBJECT) ? ".o" : ".bin";
+    const char* defaultOutput = (flags & BUILD_FLAG_OBJECT) ? "out.o" : "out.bin";
+
+    if (link) {
+        if (inputCount == 0 || manifest_path != NULL || connect_path != NULL) {
+            printf("-l links the objects given with -f, in this process\n");
+            return 1;
+        }
+
+        int result = run_link(targetPath, flags, stats, inputs, inputCount, output_path ? output_path : defaultOutput);
+        free(inputs);
+        return result;
+    }
+
+    Job* jobs = NULL;
+    uint32_t jobCount = 0;
+    uint32_t jobCapacity = 0;
+
+    // With one input the output name is ours to pick, with more every input gets its own
+    for (uint32_t i = 0; i < inputCount; i++) {
+        char* output = (inputCount == 1 && manifest_path == NULL)
+            ? copy_string(output_path ? output_path : defaultOutput, strlen(output_path ? output_path : defaultOutput))
+            : default_output_path(inputs[i], extension);
+
+        if (output == NULL || add_job(&jobs, &jobCount, &jobCapacity, inputs[i], output)) {
+            printf("Out of memory\n");
+            return 1;
+        }
+    }
+
+    if (manifest_path != NULL && read_manifest(manifest_path, extension, &jobs, &jobCount, &jobCapacity)) {
         return 1;
     }
 
-    printf("Opening file...\n");
-    
-    FILE* file = fopen(file_path, "r");
-    if(file == NULL) {
-        printf("Could not open file!\n");
+    if(jobCount == 0) {
+        printf("No file specified.\n");
         return 1;
     }
 
-    List tokens = { 0 };
-    list_init(&tokens);
+    if (output_path != NULL && jobCount > 1) {
+        printf("-o only works with a single input.\n");
+        return 1;
+    }
+    
+    if (connect_path != NULL && stats) {
+        printf("-s doesn't work with -C, the build happens in the server\n");
+        return 1;
+    }
 
-    printf("Lexing...\n");
-    LexerResult result = lex(file, &tokens);
-    if(result != LEXER_OK) {
-        printf("Lexer Errored: %s\n", get_lexer_result_msg(result));
+    if (connect_path != NULL) {
+        if (run_remote(connect_path, target_name, flags, jobs, jobCount))
+            return 1;
+    }
+    else if (run_local(targetPath, flags, stats, jobs, jobCount, threadCount)) {
         return 1;
     }
 
-    printf("parsing...");
-    
+    // Report in input order, not in the order the jobs happened to finish
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < jobCount; i++) {
+        printf("%s: %s\n", jobs[i].input, jobs[i].message);
 
-    printf("Assembling: %s\n", file_path);
+        if (stats)
+            print_stats(&jobs[i].stats);
 
-    return 0;
-}
\ No newline at end of file
+        failed += jobs[i].failed;
+
+        if (jobs[i].ownsInput)
+            free((char*)jobs[i].input);
+        free(jobs[i].output);
+    }
+
+    if (jobCount > 1)
+        printf("Assembled %u of %u files\n", jobCount - failed, jobCount);
+
+    free(jobs);
+    free(inputs);
+    return failed != 0;
+}
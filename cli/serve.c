@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <string.h>
+#include "serve.h"
+#include "../src/source.h"
+#include "../src/thread.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define TARGET_EXTENSION "so"
+
+// Targets stay loaded for as long as the server runs
+#define SERVE_MAX_TARGETS 32
+
+typedef struct {
+    char name[256];
+    BuildTarget* target;
+} LoadedTarget;
+
+typedef struct {
+    int listener;
+
+    // Only held while looking up or loading a target, builds run without it
+    Mutex lock;
+    LoadedTarget targets[SERVE_MAX_TARGETS];
+    uint32_t targetCount;
+} Server;
+
+static int read_all(int fd, void* data, size_t length) {
+    uint8_t* bytes = data;
+
+    while (length > 0) {
+        ssize_t count = read(fd, bytes, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        // End of file counts as an error too, nothing ever stops halfway through a message
+        if (count <= 0)
+            return 1;
+
+        bytes += count;
+        length -= (size_t)count;
+    }
+
+    return 0;
+}
+
+// Header, names and payload go out in one call, a write that only took part of it continues where it stopped
+static int write_all(int fd, struct iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return 1;
+
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            count--;
+        }
+
+        if (count > 0) {
+            parts->iov_base = (uint8_t*)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+
+    return 0;
+}
+
+// Names end up in a path, so anything that could leave the targets directory is turned down
+static uint8_t is_target_name(const char* name, uint32_t length) {
+    if (length == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        char chr = name[i];
+        if (!((chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') || (chr >= '0' && chr <= '9') || chr == '_' || chr == '-'))
+            return 0;
+    }
+
+    return 1;
+}
+
+static BuildTarget* find_target(Server* server, const char* name) {
+    BuildTarget* target = NULL;
+
+    mutex_lock(&server->lock);
+
+    for (uint32_t i = 0; i < server->targetCount; i++) {
+        if (strcmp(server->targets[i].name, name) == 0) {
+            target = server->targets[i].target;
+            break;
+        }
+    }
+
+    // First request for it, load and register it once and keep it
+    if (target == NULL && server->targetCount < SERVE_MAX_TARGETS) {
+        char path[300];
+        snprintf(path, sizeof(path), "targets/%s." TARGET_EXTENSION, name);
+
+        printf("Loading target: %s\n", path);
+        target = load_target_register(path);
+
+        if (target != NULL) {
+            LoadedTarget* loaded = &server->targets[server->targetCount++];
+            snprintf(loaded->name, sizeof(loaded->name), "%s", name);
+            loaded->target = target;
+        }
+    }
+
+    mutex_unlock(&server->lock);
+    return target;
+}
+
+static int send_response(int fd, ServeResponse* response, const char* message, const uint8_t* image) {
+    response->magic = SERVE_MAGIC;
+    response->messageLength = (uint16_t)strlen(message);
+
+    struct iovec parts[3] = {
+        { response, sizeof(ServeResponse) },
+        { (void*)message, response->messageLength },
+        { (void*)image, response->imageLength }
+    };
+
+    return write_all(fd, parts, 3);
+}
+
+static int send_error(int fd, const char* message) {
+    ServeResponse response = { 0 };
+    response.failed = 1;
+    response.result = BUILD_RESULT_UNKOWN_ERROR;
+
+    return send_response(fd, &response, message, NULL);
+}
+
+// Answers requests until the client hangs up, the context and the source buffer are reused for all of them
+static void serve_connection(Server* server, BuildContext* context, ByteBuffer* source, int fd) {
+    for (;;) {
+        ServeRequest request;
+        if (read_all(fd, &request, sizeof(request)))
+            return;
+
+        // There is no way to find the next request after a broken one, so the connection goes
+        if (request.magic != SERVE_MAGIC) {
+            send_error(fd, "Not a kasm request");
+            return;
+        }
+
+        if (request.sourceLength > SERVE_MAX_SOURCE) {
+            send_error(fd, "Source too large");
+            return;
+        }
+
+        char name[256];
+        if (read_all(fd, name, request.targetLength))
+            return;
+
+        name[request.targetLength] = '\0';
+
+        if (byte_buffer_reserve(source, request.sourceLength) != BYTE_BUFFER_OK) {
+            send_error(fd, "Out of memory");
+            return;
+        }
+
+        if (read_all(fd, source->data, request.sourceLength))
+            return;
+
+        // The request was read in full, so a bad target only fails this one
+        BuildTarget* target = is_target_name(name, request.targetLength) ? find_target(server, name) : NULL;
+        if (target == NULL) {
+            char message[300];
+            snprintf(message, sizeof(message), "Could not load target %s", name);
+
+            if (send_error(fd, message))
+                return;
+
+            continue;
+        }
+
+        context->target = target;
+        context->flags = (request.flags & (uint8_t)~BUILD_FLAG_SPLIT_BANKS) | BUILD_FLAG_NO_FILES;
+
+        ServeResponse response = { 0 };
+        char message[256] = { 0 };
+
+        response.failed = kasm_build_buffer((const char*)source->data, request.sourceLength, context);
+        response.result = context->assemblerResult;
+
+        if (response.failed) {
+            format_build_error(context, message, sizeof(message));
+            response.errorLine = context->errorLine;
+        }
+        else {
+            response.imageLength = context->output.length;
+            response.writtenSize = image_written_size(&context->image);
+        }
+
+        if (send_response(fd, &response, message, context->output.data))
+            return;
+    }
+}
+
+static void serve_worker(void* user) {
+    Server* server = user;
+
+    BuildContext context = { 0 };
+    ByteBuffer source = { 0 };
+
+    // Every worker waits in accept on the same socket, the os hands each connection to one of them
+    for (;;) {
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            break;
+        }
+
+        serve_connection(server, &context, &source, fd);
+        close(fd);
+    }
+
+    byte_buffer_dispose(&source);
+    kasm_context_dispose(&context);
+}
+
+int kasm_serve(const char* path, uint32_t threadCount) {
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return 1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    // A client that goes away mid response shouldn't take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server = { 0 };
+    server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listener < 0) {
+        printf("Could not create a socket\n");
+        return 1;
+    }
+
+    // A socket file left behind by an earlier server would make bind fail
+    unlink(path);
+
+    if (bind(server.listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server.listener, 64) != 0) {
+        printf("Could not listen on %s\n", path);
+        close(server.listener);
+        return 1;
+    }
+
+    mutex_init(&server.lock);
+
+    if (threadCount == 0)
+        threadCount = thread_cpu_count();
+
+    printf("Listening on %s with %u workers\n", path, threadCount);
+    fflush(stdout);
+
+    // The calling thread is a worker too
+    Thread* threads = calloc(threadCount, sizeof(Thread));
+    uint32_t started = 0;
+
+    if (threads != NULL) {
+        for (; started + 1 < threadCount; started++) {
+            if (thread_create(&threads[started], serve_worker, &server) != THREAD_OK)
+                break;
+        }
+    }
+
+    serve_worker(&server);
+
+    for (uint32_t i = 0; i < started; i++)
+        thread_join(&threads[i]);
+
+    free(threads);
+    mutex_dispose(&server.lock);
+    close(server.listener);
+    unlink(path);
+    return 1;
+}
+
+int kasm_connect(const char* path) {
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void kasm_disconnect(int connection) {
+    close(connection);
+}
+
+// Streams the image from the socket into the file, it never has to fit in memory all at once
+// The whole image is read even when writing fails, or the next response would be out of step
+static int receive_image(int connection, uint32_t length, FILE* file, uint8_t* writeFailed) {
+    uint8_t chunk[65536];
+
+    while (length > 0) {
+        uint32_t count = length < sizeof(chunk) ? length : (uint32_t)sizeof(chunk);
+        if (read_all(connection, chunk, count))
+            return 1;
+
+        if (file == NULL || fwrite(chunk, 1, count, file) != count)
+            *writeFailed = 1;
+
+        length -= count;
+    }
+
+    return 0;
+}
+
+int kasm_remote_build(int connection, const char* target, uint8_t flags, const char* input, const char* output, char* message, size_t size) {
+    if (strlen(target) > UINT8_MAX) {
+        snprintf(message, size, "Target name too long");
+        return 1;
+    }
+
+    SourceFile source;
+    SourceResult sourceResult = source_open(input, &source);
+
+    if (sourceResult != SOURCE_OK) {
+        snprintf(message, size, "%s", get_build_result_msg(sourceResult == SOURCE_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_FILE_ERROR));
+        return 1;
+    }
+
+    if (source.length > SERVE_MAX_SOURCE) {
+        source_close(&source);
+        snprintf(message, size, "Source too large for the server");
+        return 1;
+    }
+
+    ServeRequest request = { 0 };
+    request.magic = SERVE_MAGIC;
+    request.sourceLength = (uint32_t)source.length;
+    request.flags = flags;
+    request.targetLength = (uint8_t)strlen(target);
+
+    struct iovec parts[3] = {
+        { &request, sizeof(request) },
+        { (void*)target, request.targetLength },
+        { (void*)source.data, source.length }
+    };
+
+    int failed = write_all(connection, parts, 3);
+    source_close(&source);
+
+    ServeResponse response;
+    char text[256];
+
+    if (failed || read_all(connection, &response, sizeof(response)) || response.magic != SERVE_MAGIC
+        || response.messageLength >= sizeof(text) || read_all(connection, text, response.messageLength)) {
+        snprintf(message, size, "Lost the connection to the server");
+        return 1;
+    }
+
+    text[response.messageLength] = '\0';
+
+    if (response.failed) {
+        snprintf(message, size, "%s", text);
+        return 1;
+    }
+
+    FILE* file = fopen(output, "wb");
+    uint8_t writeFailed = file == NULL;
+
+    int lost = receive_image(connection, response.imageLength, file, &writeFailed);
+
+    if (file != NULL && fclose(file) != 0)
+        writeFailed = 1;
+
+    if (lost) {
+        snprintf(message, size, "Lost the connection to the server");
+        return 1;
+    }
+
+    if (writeFailed) {
+        snprintf(message, size, "%s", get_build_result_msg(BUILD_RESULT_FILE_ERROR));
+        return 1;
+    }
+
+    snprintf(message, size, "Wrote %llu bytes to %s", (unsigned long long)response.writtenSize, output);
+    return 0;
+}
+
+#else
+
+int kasm_serve(const char* path, uint32_t threadCount) {
+    printf("Serving is not supported on this platform\n");
+    return 1;
+}
+
+int kasm_connect(const char* path) {
+    return -1;
+}
+
+void kasm_disconnect(int connection) {
+}
+
+int kasm_remote_build(int connection, const char* target, uint8_t flags, const char* input, const char* output, char* message, size_t size) {
+    snprintf(message, size, "Serving is not supported on this platform");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "../src/libkasm.h"
+
+// Requests and responses go over a local socket, so everything is in the byte order of the machine
+#define SERVE_MAGIC 0x4D53414B
+
+// Sources bigger than this are turned down before anything gets allocated for them
+#define SERVE_MAX_SOURCE (256u * 1024u * 1024u)
+
+// Followed by the target name and then the source
+typedef struct {
+    uint32_t magic;
+    uint32_t sourceLength;
+
+    // Build flags, BUILD_FLAG_SPLIT_BANKS is ignored since the image comes back flat
+    // The server always adds BUILD_FLAG_NO_FILES, it would resolve .include and .incbin against its own directory
+    // and read whatever it can reach for any client of the socket, so sources using them have to be built locally
+    uint8_t flags;
+    uint8_t targetLength;
+    uint16_t reserved;
+} ServeRequest;
+
+// Followed by the message and then the flattened image, the image is empty when the build failed
+typedef struct {
+    uint32_t magic;
+    uint8_t failed;
+    uint8_t result;
+    uint16_t messageLength;
+
+    uint32_t errorLine;
+    uint32_t imageLength;
+
+    // Bytes that were actually written, the gaps in the image don't count
+    uint64_t writtenSize;
+} ServeResponse;
+
+// Shared with main.c
+BuildTarget* load_target_register(const char* path);
+void format_build_error(const BuildContext* context, char* message, size_t size);
+
+// Listens on path until the process gets killed, every worker thread keeps its own context and serves one connection at a time
+int kasm_serve(const char* path, uint32_t threadCount);
+
+// Builds input on the server at the other end of connection and writes the image it sends back to output
+// Returns 0 on success, message gets the same text a local build would report
+int kasm_remote_build(int connection, const char* target, uint8_t flags, const char* input, const char* output, char* message, size_t size);
+
+// -1 when nothing is listening on path
+int kasm_connect(const char* path);
+void kasm_disconnect(int connection);
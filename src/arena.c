@@ -0,0 +1,126 @@
+#include "arena.h"
+
+#include <string.h>
+
+static ArenaBlock* arena_new_block(size_t capacity, ArenaBlock* next) {
+	ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity);
+	if (block == NULL)
+		return NULL;
+
+	block->next = next;
+	block->used = 0;
+	block->capacity = capacity;
+
+	return block;
+}
+
+// First spare block that fits, unlinked from the spare list
+static ArenaBlock* arena_take_spare(Arena* arena, size_t capacity) {
+	ArenaBlock** link = &arena->spare;
+	while (*link != NULL) {
+		ArenaBlock* block = *link;
+		if (block->capacity >= capacity) {
+			*link = block->next;
+			block->used = 0;
+			return block;
+		}
+
+		link = &block->next;
+	}
+
+	return NULL;
+}
+
+void arena_init(Arena* arena, size_t blockSize) {
+	arena->head = NULL;
+	arena->blockSize = blockSize ? blockSize : ARENA_BLOCK_SIZE;
+	arena->spare = NULL;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+	ArenaBlock* block = arena->head;
+	if (block == NULL || block->used + size > block->capacity) {
+		// Oversized requests get a block of their own so we don't waste the rest of a regular one
+		size_t blockSize = arena->blockSize ? arena->blockSize : ARENA_BLOCK_SIZE;
+		size_t capacity = size > blockSize ? size : blockSize;
+
+		block = arena_take_spare(arena, capacity);
+		if (block != NULL)
+			block->next = arena->head;
+		else
+			block = arena_new_block(capacity, arena->head);
+
+		if (block == NULL)
+			return NULL;
+
+		arena->head = block;
+	}
+
+	void* ptr = &block->data[block->used];
+	block->used += size;
+
+	return ptr;
+}
+
+void* arena_calloc(Arena* arena, size_t size) {
+	void* ptr = arena_alloc(arena, size);
+	if (ptr != NULL)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+char* arena_strndup(Arena* arena, const char* value, size_t length) {
+	char* str = arena_alloc(arena, length + 1);
+	if (str == NULL)
+		return NULL;
+
+	memcpy(str, value, length);
+	str[length] = '\0';
+
+	return str;
+}
+
+void arena_reset(Arena* arena) {
+	// The oldest block ends up first, so the next build fills them in the same order
+	while (arena->head != NULL) {
+		ArenaBlock* block = arena->head;
+		arena->head = block->next;
+
+		block->used = 0;
+		block->next = arena->spare;
+		arena->spare = block;
+	}
+}
+
+static void arena_free_blocks(ArenaBlock* block) {
+	while (block != NULL) {
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+}
+
+static size_t arena_block_bytes(const ArenaBlock* block) {
+	size_t size = 0;
+
+	for (; block != NULL; block = block->next) {
+		size += sizeof(ArenaBlock) + block->capacity;
+	}
+
+	return size;
+}
+
+size_t arena_size(const Arena* arena) {
+	return arena_block_bytes(arena->head) + arena_block_bytes(arena->spare);
+}
+
+void arena_dispose(Arena* arena) {
+	arena_free_blocks(arena->head);
+	arena_free_blocks(arena->spare);
+
+	arena->head = NULL;
+	arena->spare = NULL;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT  8
+
+typedef struct ArenaBlock {
+	struct ArenaBlock* next;
+	size_t used;
+	size_t capacity;
+	uint8_t data[];
+} ArenaBlock;
+
+// Bump allocator, everything allocated from it is released at once by arena_reset or arena_dispose
+// A zero initialized arena is valid and uses ARENA_BLOCK_SIZE blocks
+typedef struct {
+	ArenaBlock* head;
+	size_t blockSize;
+
+	// Blocks from before the last reset, handed out again before anything new gets allocated
+	ArenaBlock* spare;
+} Arena;
+
+void arena_init(Arena* arena, size_t blockSize);
+
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t size);
+char* arena_strndup(Arena* arena, const char* value, size_t length);
+
+// Releases every allocation, the blocks stay around so the next build of the same size allocates nothing
+void arena_reset(Arena* arena);
+void arena_dispose(Arena* arena);
+
+// Bytes held in blocks, the spare ones included
+size_t arena_size(const Arena* arena);
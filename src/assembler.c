@@ -0,0 +1,336 @@
+#include "assembler.h"
+#include "opcode.h"
+
+#include <string.h>
+
+static uint8_t fits_in(uint32_t value, uint8_t size) {
+    return size >= 4 || value < (1u << (size * 8));
+}
+
+static void write_value(uint8_t* bytes, uint32_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// Everything has to fit in the address space of the target
+static AssemblerResult advance(BuildContext* context, uint32_t size) {
+    uint8_t addressSize = context->target->addressSize;
+    uint64_t end = (uint64_t)context->position + size;
+
+    if (addressSize < 4 && end > ((uint64_t)1 << (addressSize * 8))) {
+        return ASSEMBLER_ADDRESS_OUT_OF_RANGE;
+    }
+
+    context->position = (uint32_t)end;
+    return ASSEMBLER_OK;
+}
+
+static uint8_t argument_size(BuildContext* context, const Argument* argument) {
+    // Immediates in data are single bytes, anything address like takes a full address
+    return argument->type == ARGUMENT_IMMEDIATE ? 1 : context->target->addressSize;
+}
+
+// Directives that put bytes in the image, the rest only move the position
+static uint8_t emits_bytes(const Action* action) {
+    return action->value == DIRECTIVE_DB || action->value == DIRECTIVE_INCBIN;
+}
+
+static uint32_t action_size(BuildContext* context, const Action* action) {
+    if (action->type == ACTION_TYPE_OPCODE) {
+        return context->target->opcodeIndex->lengths[action->value];
+    }
+
+    if (action->type == ACTION_TYPE_DIRECTIVE && action->value == DIRECTIVE_DB) {
+        uint32_t size = 0;
+        for (uint16_t i = 0; i < action->argumentCount; i++) {
+            size += argument_size(context, &action->arguments[i]);
+        }
+
+        return size;
+    }
+
+    // The parser left the index of the mapping, the offset and the length
+    if (action->type == ACTION_TYPE_DIRECTIVE && action->value == DIRECTIVE_INCBIN) {
+        return action->arguments[2].value;
+    }
+
+    return 0;
+}
+
+// .org and .bank only move us around
+static AssemblerResult apply_directive(BuildContext* context, const Action* action) {
+    if (action->value != DIRECTIVE_ORG && action->value != DIRECTIVE_BANK) {
+        return ASSEMBLER_OK;
+    }
+
+    if (action->argumentCount != 1 || action->arguments[0].type == ARGUMENT_REGISTER || action->arguments[0].type == ARGUMENT_LABEL) {
+        return ASSEMBLER_INVALID_ARGUMENTS;
+    }
+
+    if (action->value == DIRECTIVE_BANK) {
+        context->bank = action->arguments[0].value;
+        return ASSEMBLER_OK;
+    }
+
+    context->position = 0;
+    return advance(context, action->arguments[0].value);
+}
+
+static AssemblerResult image_result_to_assembler_result(ImageResult result) {
+    switch (result) {
+    case IMAGE_OK:              return ASSEMBLER_OK;
+    case IMAGE_ALLOC_FAILED:    return ASSEMBLER_ALLOC_FAILED;
+    case IMAGE_OVERLAP:         return ASSEMBLER_OUTPUT_OVERLAP;
+    case IMAGE_TOO_LARGE:       return ASSEMBLER_ADDRESS_OUT_OF_RANGE;
+    case IMAGE_UNWRITTEN:       return ASSEMBLER_IMAGE_ERROR;
+    case IMAGE_FILE_ERROR:      return ASSEMBLER_IMAGE_ERROR;
+    }
+
+    return ASSEMBLER_IMAGE_ERROR;
+}
+
+static AssemblerResult write_bytes(BuildContext* context, uint32_t address, const uint8_t* bytes, uint32_t size) {
+    return image_result_to_assembler_result(image_write(&context->image, context->bank, address, bytes, size));
+}
+
+static Fixup* alloc_fixup(BuildContext* context) {
+    Fixup* fixup = context->freeFixups;
+    if (fixup != NULL) {
+        context->freeFixups = fixup->next;
+        return fixup;
+    }
+
+    return arena_alloc(&context->arena, sizeof(Fixup));
+}
+
+// Writes a label address, or leaves zeroes and a fixup when we don't know it yet
+static AssemblerResult encode_label(BuildContext* context, uint8_t* bytes, uint32_t id, uint32_t address, uint8_t size) {
+    Symbol* symbol = symbol_table_get(&context->labels, id);
+
+    if (symbol->defined) {
+        if (!fits_in(symbol->position, size)) {
+            return ASSEMBLER_VALUE_OUT_OF_RANGE;
+        }
+
+        write_value(bytes, symbol->position, size);
+        return ASSEMBLER_OK;
+    }
+
+    Fixup* fixup = alloc_fixup(context);
+    if (fixup == NULL) {
+        return ASSEMBLER_ALLOC_FAILED;
+    }
+
+    fixup->bank = context->bank;
+    fixup->address = address;
+    fixup->size = size;
+    fixup->next = symbol->fixups;
+    symbol->fixups = fixup;
+
+    memset(bytes, 0, size);
+    return ASSEMBLER_OK;
+}
+
+static AssemblerResult encode_argument(BuildContext* context, uint8_t* bytes, const Argument* argument, uint32_t address, uint8_t size) {
+    if (argument->type == ARGUMENT_LABEL) {
+        return encode_label(context, bytes, argument->value, address, size);
+    }
+
+    if (!fits_in(argument->value, size)) {
+        return ASSEMBLER_VALUE_OUT_OF_RANGE;
+    }
+
+    write_value(bytes, argument->value, size);
+    return ASSEMBLER_OK;
+}
+
+static AssemblerResult encode_opcode(BuildContext* context, const Action* action, uint8_t* bytes) {
+    const OpcodeIndex* index = context->target->opcodeIndex;
+    uint32_t signature = index->operands[action->value];
+
+    write_value(bytes, action->value, index->opcodeSize);
+    uint32_t offset = index->opcodeSize;
+
+    for (uint16_t i = 0; i < action->argumentCount; i++) {
+        uint8_t size = index->operandSizes[opcode_signature_operand(signature, (uint8_t)i)];
+
+        AssemblerResult result = encode_argument(context, &bytes[offset], &action->arguments[i], context->position + offset, size);
+        if (result != ASSEMBLER_OK) {
+            return result;
+        }
+
+        offset += size;
+    }
+
+    return ASSEMBLER_OK;
+}
+
+static AssemblerResult encode_data(BuildContext* context, const Action* action) {
+    uint32_t address = context->position;
+
+    for (uint16_t i = 0; i < action->argumentCount; i++) {
+        const Argument* argument = &action->arguments[i];
+        if (argument->type == ARGUMENT_REGISTER) {
+            return ASSEMBLER_INVALID_ARGUMENTS;
+        }
+
+        uint8_t bytes[4];
+        uint8_t size = argument_size(context, argument);
+
+        AssemblerResult result = encode_argument(context, bytes, argument, address, size);
+        if (result != ASSEMBLER_OK) {
+            return result;
+        }
+
+        if ((result = write_bytes(context, address, bytes, size)) != ASSEMBLER_OK) {
+            return result;
+        }
+
+        address += size;
+    }
+
+    return ASSEMBLER_OK;
+}
+
+// One copy from the mapped file into the image, no matter how big it is
+static AssemblerResult encode_binary(BuildContext* context, const Action* action) {
+    const SourceFile* file = VECTOR_AT(&context->binaries, SourceFile, action->arguments[0].value);
+    const uint8_t* bytes = (const uint8_t*)file->data + action->arguments[1].value;
+
+    return write_bytes(context, context->position, bytes, action->arguments[2].value);
+}
+
+AssemblerResult assemble_action(BuildContext* context, const Action* action) {
+    uint32_t size = action_size(context, action);
+
+    // Check the whole action fits before we write anything
+    uint32_t start = context->position;
+
+    AssemblerResult result;
+    if ((result = advance(context, size)) != ASSEMBLER_OK) {
+        return result;
+    }
+
+    context->position = start;
+
+    if (action->type == ACTION_TYPE_OPCODE) {
+        uint8_t bytes[ASSEMBLER_MAX_INSTRUCTION_SIZE];
+
+        if ((result = encode_opcode(context, action, bytes)) != ASSEMBLER_OK) {
+            return result;
+        }
+
+        if ((result = write_bytes(context, start, bytes, size)) != ASSEMBLER_OK) {
+            return result;
+        }
+    }
+    else if (action->type == ACTION_TYPE_DIRECTIVE) {
+        if (!emits_bytes(action)) {
+            return apply_directive(context, action);
+        }
+
+        result = action->value == DIRECTIVE_DB ? encode_data(context, action) : encode_binary(context, action);
+        if (result != ASSEMBLER_OK) {
+            return result;
+        }
+    }
+
+    context->position = start + size;
+    return ASSEMBLER_OK;
+}
+
+AssemblerResult assemble_skip_action(BuildContext* context, const Action* action) {
+    if (action->type == ACTION_TYPE_DIRECTIVE && !emits_bytes(action)) {
+        return apply_directive(context, action);
+    }
+
+    return advance(context, action_size(context, action));
+}
+
+AssemblerResult assemble_define_label(BuildContext* context, uint32_t id) {
+    Symbol* symbol = symbol_table_get(&context->labels, id);
+
+    Fixup* fixup = symbol->fixups;
+    while (fixup != NULL) {
+        Fixup* next = fixup->next;
+
+        if (!fits_in(symbol->position, fixup->size)) {
+            return ASSEMBLER_VALUE_OUT_OF_RANGE;
+        }
+
+        uint8_t bytes[4];
+        write_value(bytes, symbol->position, fixup->size);
+
+        // The reference left zeroes here when it was encoded
+        AssemblerResult result = image_result_to_assembler_result(image_patch(&context->image, fixup->bank, fixup->address, bytes, fixup->size));
+        if (result != ASSEMBLER_OK) {
+            return result;
+        }
+
+        fixup->next = context->freeFixups;
+        context->freeFixups = fixup;
+        fixup = next;
+    }
+
+    symbol->fixups = NULL;
+    return ASSEMBLER_OK;
+}
+
+AssemblerResult assemble_reference(BuildContext* context, uint32_t id, uint32_t bank, uint32_t address, uint8_t size) {
+    Symbol* symbol = symbol_table_get(&context->labels, id);
+
+    if (symbol->defined) {
+        if (!fits_in(symbol->position, size)) {
+            return ASSEMBLER_VALUE_OUT_OF_RANGE;
+        }
+
+        uint8_t bytes[4];
+        write_value(bytes, symbol->position, size);
+        return image_result_to_assembler_result(image_patch(&context->image, bank, address, bytes, size));
+    }
+
+    Fixup* fixup = alloc_fixup(context);
+    if (fixup == NULL) {
+        return ASSEMBLER_ALLOC_FAILED;
+    }
+
+    fixup->bank = bank;
+    fixup->address = address;
+    fixup->size = size;
+    fixup->next = symbol->fixups;
+    symbol->fixups = fixup;
+
+    return ASSEMBLER_OK;
+}
+
+AssemblerResult kasm_assemble(BuildContext* context) {
+    context->position = 0;
+    context->bank = 0;
+
+    // The parser already laid out every label, so nothing needs a fixup here
+    for (uint32_t i = 0; i < context->actions.count; i++) {
+        const Action* action = VECTOR_AT(&context->actions, Action, i);
+
+        AssemblerResult result = assemble_action(context, action);
+        if (result != ASSEMBLER_OK) {
+            context->errorLine = action->line;
+            return result;
+        }
+    }
+
+    return ASSEMBLER_OK;
+}
+
+const char* get_assembler_result_msg(AssemblerResult result) {
+    switch (result) {
+    case ASSEMBLER_OK:                      return "OK";
+    case ASSEMBLER_ALLOC_FAILED:            return "Allocation Failed";
+    case ASSEMBLER_VALUE_OUT_OF_RANGE:      return "Value Out Of Range";
+    case ASSEMBLER_ADDRESS_OUT_OF_RANGE:    return "Address Out Of Range";
+    case ASSEMBLER_INVALID_ARGUMENTS:       return "Invalid Arguments";
+    case ASSEMBLER_OUTPUT_OVERLAP:          return "Overlapping Output";
+    case ASSEMBLER_IMAGE_ERROR:             return "Image Error";
+    default:                                return "???";
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "libkasm.h"
+
+// Largest encoding we ever build on the stack, a 2 byte opcode with the max operands of 4 bytes
+#define ASSEMBLER_MAX_INSTRUCTION_SIZE 64
+
+typedef enum {
+    ASSEMBLER_OK,
+    ASSEMBLER_ALLOC_FAILED,
+    ASSEMBLER_VALUE_OUT_OF_RANGE,
+    ASSEMBLER_ADDRESS_OUT_OF_RANGE,
+    ASSEMBLER_INVALID_ARGUMENTS,
+
+    // Bytes land where an earlier .org region already put some
+    ASSEMBLER_OUTPUT_OVERLAP,
+
+    // The image refused a write that should always work, like patching a fixup whose bytes are gone
+    // That is a bug rather than bad source
+    ASSEMBLER_IMAGE_ERROR
+} AssemblerResult;
+
+// Encodes the action at the current position and moves past it
+// Labels that aren't defined yet get a fixup, which assemble_define_label patches later
+AssemblerResult assemble_action(BuildContext* context, const Action* action);
+
+// Moves the position past the action without encoding it, used to lay out labels before the second pass
+AssemblerResult assemble_skip_action(BuildContext* context, const Action* action);
+
+// Patches every reference that was waiting on this label
+AssemblerResult assemble_define_label(BuildContext* context, uint32_t symbol);
+
+// A label reference whose bytes are already in the image as zeroes, the linker adds these from relocations
+// It gets patched right away when the label is defined, otherwise once it is
+AssemblerResult assemble_reference(BuildContext* context, uint32_t symbol, uint32_t bank, uint32_t address, uint8_t size);
+
+// Second pass, encodes every action the parser collected
+AssemblerResult kasm_assemble(BuildContext* context);
+
+const char* get_assembler_result_msg(AssemblerResult result);
@@ -0,0 +1,66 @@
+#include "buffer.h"
+
+#include <string.h>
+
+ByteBufferResult byte_buffer_reserve(ByteBuffer* buffer, uint32_t capacity) {
+	if (capacity <= buffer->capacity)
+		return BYTE_BUFFER_OK;
+
+	if (buffer->borrowed)
+		return BYTE_BUFFER_FULL;
+
+	uint32_t grown = buffer->capacity ? buffer->capacity : BYTE_BUFFER_INITIAL_CAPACITY;
+	while (grown < capacity)
+		grown = grown > UINT32_MAX / 2 ? capacity : grown * 2;
+
+	uint8_t* data = realloc(buffer->data, grown);
+	if (data == NULL)
+		return BYTE_BUFFER_ALLOC_FAILED;
+
+	buffer->data = data;
+	buffer->capacity = grown;
+
+	return BYTE_BUFFER_OK;
+}
+
+ByteBufferResult byte_buffer_write(ByteBuffer* buffer, uint32_t offset, const void* data, uint32_t length) {
+	uint64_t end = (uint64_t)offset + length;
+	if (end > UINT32_MAX)
+		return buffer->borrowed ? BYTE_BUFFER_FULL : BYTE_BUFFER_ALLOC_FAILED;
+
+	ByteBufferResult result = byte_buffer_reserve(buffer, (uint32_t)end);
+	if (result != BYTE_BUFFER_OK)
+		return result;
+
+	if (offset > buffer->length)
+		memset(&buffer->data[buffer->length], 0, offset - buffer->length);
+
+	memcpy(&buffer->data[offset], data, length);
+
+	if (end > buffer->length)
+		buffer->length = (uint32_t)end;
+
+	return BYTE_BUFFER_OK;
+}
+
+void byte_buffer_wrap(ByteBuffer* buffer, uint8_t* data, uint32_t capacity) {
+	byte_buffer_dispose(buffer);
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+	buffer->borrowed = 1;
+}
+
+void byte_buffer_clear(ByteBuffer* buffer) {
+	buffer->length = 0;
+}
+
+void byte_buffer_dispose(ByteBuffer* buffer) {
+	if (!buffer->borrowed)
+		free(buffer->data);
+
+	buffer->data = NULL;
+	buffer->length = 0;
+	buffer->capacity = 0;
+	buffer->borrowed = 0;
+}
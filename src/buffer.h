@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BYTE_BUFFER_INITIAL_CAPACITY 256
+
+typedef enum {
+	BYTE_BUFFER_OK,
+	BYTE_BUFFER_ALLOC_FAILED,
+	BYTE_BUFFER_FULL
+} ByteBufferResult;
+
+// Growable byte array, a zero initialized buffer is empty and valid
+typedef struct {
+	uint8_t* data;
+	uint32_t length;
+	uint32_t capacity;
+
+	// Memory the caller handed in, it never grows and never gets freed
+	uint8_t borrowed;
+} ByteBuffer;
+
+// Writes go into data[0, capacity) from now on, anything that doesn't fit fails with BYTE_BUFFER_FULL
+void byte_buffer_wrap(ByteBuffer* buffer, uint8_t* data, uint32_t capacity);
+
+ByteBufferResult byte_buffer_reserve(ByteBuffer* buffer, uint32_t capacity);
+
+// Writes at any offset, a gap between the old length and the offset is filled with zeroes
+ByteBufferResult byte_buffer_write(ByteBuffer* buffer, uint32_t offset, const void* data, uint32_t length);
+
+void byte_buffer_clear(ByteBuffer* buffer);
+void byte_buffer_dispose(ByteBuffer* buffer);
@@ -0,0 +1,494 @@
+#include "image.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <stdio.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static inline uint64_t image_key(uint32_t bank, uint32_t address) {
+	return ((uint64_t)bank << 32) | address;
+}
+
+static inline uint64_t segment_end(const ImageSegment* segment) {
+	return (uint64_t)segment->address + segment->bytes.length;
+}
+
+// Index of the first segment that starts after (bank, address), the one before it is the only one that can contain it
+static uint32_t image_find(const Image* image, uint32_t bank, uint32_t address) {
+	uint64_t key = image_key(bank, address);
+	ImageSegment* segments = image->segments;
+
+	// Writes mostly continue where the last one stopped
+	uint32_t last = image->last;
+	if (last < image->count && image_key(segments[last].bank, segments[last].address) <= key
+		&& (last + 1 == image->count || image_key(segments[last + 1].bank, segments[last + 1].address) > key))
+		return last + 1;
+
+	uint32_t low = 0;
+	uint32_t high = image->count;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (image_key(segments[middle].bank, segments[middle].address) <= key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+static ImageSegment* image_insert(Image* image, uint32_t index) {
+	if (image->count == image->capacity) {
+		uint32_t capacity = image->capacity ? image->capacity * 2 : IMAGE_INITIAL_CAPACITY;
+		ImageSegment* segments = realloc(image->segments, sizeof(ImageSegment) * capacity);
+		if (segments == NULL)
+			return NULL;
+
+		memset(&segments[image->capacity], 0, sizeof(ImageSegment) * (capacity - image->capacity));
+		image->segments = segments;
+		image->capacity = capacity;
+	}
+
+	// The cleared segment past the end brings its buffer along
+	ImageSegment spare = image->segments[image->count];
+	memmove(&image->segments[index + 1], &image->segments[index], sizeof(ImageSegment) * (image->count - index));
+
+	image->segments[index] = spare;
+	image->segments[index].bytes.length = 0;
+	image->count++;
+
+	return &image->segments[index];
+}
+
+static void image_remove(Image* image, uint32_t index) {
+	ImageSegment removed = image->segments[index];
+	memmove(&image->segments[index], &image->segments[index + 1], sizeof(ImageSegment) * (image->count - index - 1));
+
+	image->count--;
+	image->segments[image->count] = removed;
+	image->segments[image->count].bytes.length = 0;
+}
+
+ImageResult image_write(Image* image, uint32_t bank, uint32_t address, const uint8_t* data, uint32_t length) {
+	if (length == 0)
+		return IMAGE_OK;
+
+	uint64_t end = (uint64_t)address + length;
+	if (end > UINT32_MAX)
+		return IMAGE_TOO_LARGE;
+
+	uint32_t index = image_find(image, bank, address);
+	ImageSegment* previous = index > 0 && image->segments[index - 1].bank == bank ? &image->segments[index - 1] : NULL;
+	ImageSegment* next = index < image->count && image->segments[index].bank == bank ? &image->segments[index] : NULL;
+
+	if ((previous != NULL && segment_end(previous) > address) || (next != NULL && next->address < end)) {
+		if (!image->overwrite)
+			return IMAGE_OVERLAP;
+
+		// Rewriting bytes inside one segment is the common case, that is a plain copy
+		if (previous != NULL && segment_end(previous) >= end) {
+			memcpy(&previous->bytes.data[address - previous->address], data, length);
+			image->last = index - 1;
+			return IMAGE_OK;
+		}
+
+		ImageResult result = image_erase(image, bank, address, length);
+		if (result != IMAGE_OK)
+			return result;
+
+		return image_write(image, bank, address, data, length);
+	}
+
+	// Right after the previous segment, which might now run into the next one
+	if (previous != NULL && segment_end(previous) == address) {
+		if (byte_buffer_write(&previous->bytes, previous->bytes.length, data, length) != BYTE_BUFFER_OK)
+			return IMAGE_ALLOC_FAILED;
+
+		if (next != NULL && next->address == end) {
+			if (byte_buffer_write(&previous->bytes, previous->bytes.length, next->bytes.data, next->bytes.length) != BYTE_BUFFER_OK)
+				return IMAGE_ALLOC_FAILED;
+
+			image_remove(image, index);
+		}
+
+		image->last = index - 1;
+		return IMAGE_OK;
+	}
+
+	// Right before the next segment
+	if (next != NULL && next->address == end) {
+		ByteBuffer* bytes = &next->bytes;
+		if (byte_buffer_reserve(bytes, bytes->length + length) != BYTE_BUFFER_OK)
+			return IMAGE_ALLOC_FAILED;
+
+		memmove(&bytes->data[length], bytes->data, bytes->length);
+		memcpy(bytes->data, data, length);
+		bytes->length += length;
+		next->address = address;
+
+		image->last = index;
+		return IMAGE_OK;
+	}
+
+	ImageSegment* segment = image_insert(image, index);
+	if (segment == NULL)
+		return IMAGE_ALLOC_FAILED;
+
+	segment->bank = bank;
+	segment->address = address;
+
+	if (byte_buffer_write(&segment->bytes, 0, data, length) != BYTE_BUFFER_OK) {
+		image_remove(image, index);
+		return IMAGE_ALLOC_FAILED;
+	}
+
+	image->last = index;
+	return IMAGE_OK;
+}
+
+ImageResult image_patch(Image* image, uint32_t bank, uint32_t address, const uint8_t* data, uint32_t length) {
+	uint32_t index = image_find(image, bank, address);
+	if (index == 0)
+		return IMAGE_UNWRITTEN;
+
+	ImageSegment* segment = &image->segments[index - 1];
+	if (segment->bank != bank || (uint64_t)address + length > segment_end(segment))
+		return IMAGE_UNWRITTEN;
+
+	memcpy(&segment->bytes.data[address - segment->address], data, length);
+	return IMAGE_OK;
+}
+
+ImageResult image_erase(Image* image, uint32_t bank, uint32_t address, uint32_t length) {
+	if (length == 0)
+		return IMAGE_OK;
+
+	uint64_t end = (uint64_t)address + length;
+
+	// The segment before the range can reach into it
+	uint32_t index = image_find(image, bank, address);
+	if (index > 0 && image->segments[index - 1].bank == bank && segment_end(&image->segments[index - 1]) > address)
+		index--;
+
+	while (index < image->count) {
+		ImageSegment* segment = &image->segments[index];
+		if (segment->bank != bank || segment->address >= end)
+			break;
+
+		uint64_t segmentEnd = segment_end(segment);
+
+		if (segment->address < address) {
+			// The range is inside this segment, the part after it becomes a segment of its own
+			if (segmentEnd > end) {
+				ImageSegment* tail = image_insert(image, index + 1);
+				if (tail == NULL)
+					return IMAGE_ALLOC_FAILED;
+
+				segment = &image->segments[index];
+				tail->bank = bank;
+				tail->address = (uint32_t)end;
+
+				if (byte_buffer_write(&tail->bytes, 0, &segment->bytes.data[end - segment->address], (uint32_t)(segmentEnd - end)) != BYTE_BUFFER_OK) {
+					image_remove(image, index + 1);
+					return IMAGE_ALLOC_FAILED;
+				}
+			}
+
+			segment->bytes.length = address - segment->address;
+			index++;
+			continue;
+		}
+
+		// Only the front of this one is in the range
+		if (segmentEnd > end) {
+			uint32_t cut = (uint32_t)(end - segment->address);
+			memmove(segment->bytes.data, &segment->bytes.data[cut], segment->bytes.length - cut);
+			segment->bytes.length -= cut;
+			segment->address = (uint32_t)end;
+			break;
+		}
+
+		image_remove(image, index);
+	}
+
+	image->last = index > 0 ? index - 1 : 0;
+	return IMAGE_OK;
+}
+
+ImageResult image_move(Image* image, uint32_t bank, uint32_t from, uint32_t length, uint32_t to) {
+	if (length == 0 || from == to)
+		return IMAGE_OK;
+
+	uint64_t end = (uint64_t)from + length;
+
+	// Copy out every written piece of the range as address, length and bytes, then put them back shifted
+	ByteBuffer* scratch = &image->scratch;
+	scratch->length = 0;
+
+	uint32_t index = image_find(image, bank, from);
+	if (index > 0 && image->segments[index - 1].bank == bank && segment_end(&image->segments[index - 1]) > from)
+		index--;
+
+	for (; index < image->count; index++) {
+		ImageSegment* segment = &image->segments[index];
+		if (segment->bank != bank || segment->address >= end)
+			break;
+
+		uint64_t start = segment->address > from ? segment->address : from;
+		uint64_t stop = segment_end(segment) < end ? segment_end(segment) : end;
+		uint32_t piece[2] = { (uint32_t)start, (uint32_t)(stop - start) };
+
+		if (byte_buffer_write(scratch, scratch->length, piece, sizeof(piece)) != BYTE_BUFFER_OK
+			|| byte_buffer_write(scratch, scratch->length, &segment->bytes.data[start - segment->address], piece[1]) != BYTE_BUFFER_OK)
+			return IMAGE_ALLOC_FAILED;
+	}
+
+	ImageResult result = image_erase(image, bank, from, length);
+	if (result != IMAGE_OK)
+		return result;
+
+	uint32_t offset = 0;
+	while (offset < scratch->length) {
+		uint32_t piece[2];
+		memcpy(piece, &scratch->data[offset], sizeof(piece));
+		offset += sizeof(piece);
+
+		uint64_t target = (uint64_t)(piece[0] - from) + to;
+		if (target > UINT32_MAX)
+			return IMAGE_TOO_LARGE;
+
+		if ((result = image_write(image, bank, (uint32_t)target, &scratch->data[offset], piece[1])) != IMAGE_OK)
+			return result;
+
+		offset += piece[1];
+	}
+
+	return IMAGE_OK;
+}
+
+uint64_t image_written_size(const Image* image) {
+	uint64_t size = 0;
+	for (uint32_t i = 0; i < image->count; i++)
+		size += image->segments[i].bytes.length;
+
+	return size;
+}
+
+// UINT64_MAX when the bank puts it past what 64 bits can address
+static uint64_t flat_offset(const ImageSegment* segment, uint64_t bankSize) {
+	if (segment->bank != 0 && bankSize > (UINT64_MAX - segment->address) / segment->bank)
+		return UINT64_MAX;
+
+	return segment->bank * bankSize + segment->address;
+}
+
+uint64_t image_flat_size(const Image* image, uint64_t bankSize) {
+	if (image->count == 0)
+		return 0;
+
+	const ImageSegment* last = &image->segments[image->count - 1];
+	uint64_t offset = flat_offset(last, bankSize);
+	if (offset > UINT64_MAX - last->bytes.length)
+		return UINT64_MAX;
+
+	return offset + last->bytes.length;
+}
+
+ImageResult image_flatten(const Image* image, uint64_t bankSize, ByteBuffer* output) {
+	output->length = 0;
+
+	uint64_t size = image_flat_size(image, bankSize);
+	if (size > UINT32_MAX)
+		return IMAGE_TOO_LARGE;
+
+	switch (byte_buffer_reserve(output, (uint32_t)size)) {
+		case BYTE_BUFFER_OK:    break;
+		case BYTE_BUFFER_FULL:  return IMAGE_TOO_LARGE;
+		default:                return IMAGE_ALLOC_FAILED;
+	}
+
+	uint64_t position = 0;
+	for (uint32_t i = 0; i < image->count; i++) {
+		const ImageSegment* segment = &image->segments[i];
+		uint64_t offset = flat_offset(segment, bankSize);
+
+		memset(&output->data[position], 0, offset - position);
+		memcpy(&output->data[offset], segment->bytes.data, segment->bytes.length);
+		position = offset + segment->bytes.length;
+	}
+
+	output->length = (uint32_t)size;
+	return IMAGE_OK;
+}
+
+#ifndef _WIN32
+// Segments per writev call, gaps take a vector of their own
+#define IMAGE_SAVE_BATCH 64
+
+// Gaps up to this size are written out, anything bigger is seeked over and left as a hole
+#define IMAGE_ZERO_FILL 4096
+
+static const uint8_t gZeroes[IMAGE_ZERO_FILL];
+
+// writev can stop short, this picks up where it left off
+static uint8_t write_vectors(int file, struct iovec* vectors, int count) {
+	while (count > 0) {
+		ssize_t written = writev(file, vectors, count);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return 1;
+		}
+
+		while (count > 0 && (size_t)written >= vectors->iov_len) {
+			written -= (ssize_t)vectors->iov_len;
+			vectors++;
+			count--;
+		}
+
+		if (count > 0) {
+			vectors->iov_base = (uint8_t*)vectors->iov_base + written;
+			vectors->iov_len -= (size_t)written;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+// Writes segments [first, end), each at its flat offset counted from firstBank
+static ImageResult image_save_range(const Image* image, uint32_t first, uint32_t end, uint32_t firstBank, uint64_t bankSize, const char* path) {
+#ifdef _WIN32
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return IMAGE_FILE_ERROR;
+
+	uint8_t failed = 0;
+	for (uint32_t i = first; i < end && !failed; i++) {
+		ImageSegment segment = image->segments[i];
+		segment.bank -= firstBank;
+
+		uint64_t offset = flat_offset(&segment, bankSize);
+		if (offset > INT64_MAX)
+			failed = 1;
+
+		// Seeking past the end fills the gap with zeroes once we write after it
+		failed = failed || _fseeki64(file, (long long)offset, SEEK_SET) != 0
+			|| fwrite(segment.bytes.data, 1, segment.bytes.length, file) != segment.bytes.length;
+	}
+
+	if (fclose(file) != 0)
+		failed = 1;
+
+	return failed ? IMAGE_FILE_ERROR : IMAGE_OK;
+#else
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+		return IMAGE_FILE_ERROR;
+
+	struct iovec vectors[IMAGE_SAVE_BATCH];
+	int count = 0;
+
+	uint64_t position = 0;
+	uint8_t failed = 0;
+
+	for (uint32_t i = first; i < end && !failed; i++) {
+		ImageSegment segment = image->segments[i];
+		segment.bank -= firstBank;
+
+		uint64_t offset = flat_offset(&segment, bankSize);
+		if (offset > INT64_MAX) {
+			failed = 1;
+			break;
+		}
+
+		if (offset - position > IMAGE_ZERO_FILL) {
+			failed = write_vectors(file, vectors, count) || lseek(file, (off_t)offset, SEEK_SET) < 0;
+			count = 0;
+		}
+		else if (offset > position) {
+			vectors[count].iov_base = (void*)gZeroes;
+			vectors[count].iov_len = (size_t)(offset - position);
+			count++;
+		}
+
+		vectors[count].iov_base = segment.bytes.data;
+		vectors[count].iov_len = segment.bytes.length;
+		count++;
+
+		position = offset + segment.bytes.length;
+
+		if (count >= IMAGE_SAVE_BATCH - 1) {
+			failed = failed || write_vectors(file, vectors, count);
+			count = 0;
+		}
+	}
+
+	if (!failed)
+		failed = write_vectors(file, vectors, count);
+
+	if (close(file) != 0)
+		failed = 1;
+
+	return failed ? IMAGE_FILE_ERROR : IMAGE_OK;
+#endif
+}
+
+ImageResult image_save(const Image* image, uint64_t bankSize, const char* path) {
+	if (image_flat_size(image, bankSize) > INT64_MAX)
+		return IMAGE_TOO_LARGE;
+
+	return image_save_range(image, 0, image->count, 0, bankSize, path);
+}
+
+ImageResult image_save_bank(const Image* image, uint32_t bank, const char* path) {
+	uint32_t first = image_find(image, bank, 0);
+	if (first > 0 && image->segments[first - 1].bank == bank)
+		first--;
+
+	uint32_t end = first;
+	while (end < image->count && image->segments[end].bank == bank)
+		end++;
+
+	return image_save_range(image, first, end, bank, 0, path);
+}
+
+void image_clear(Image* image) {
+	for (uint32_t i = 0; i < image->count; i++)
+		image->segments[i].bytes.length = 0;
+
+	image->count = 0;
+	image->last = 0;
+}
+
+void image_dispose(Image* image) {
+	for (uint32_t i = 0; i < image->capacity; i++)
+		byte_buffer_dispose(&image->segments[i].bytes);
+
+	free(image->segments);
+	byte_buffer_dispose(&image->scratch);
+
+	image->segments = NULL;
+	image->count = 0;
+	image->capacity = 0;
+	image->last = 0;
+}
+
+const char* get_image_result_msg(ImageResult result) {
+	switch (result) {
+		case IMAGE_OK:              return "OK";
+		case IMAGE_ALLOC_FAILED:    return "Allocation Failed";
+		case IMAGE_OVERLAP:         return "Overlapping Output";
+		case IMAGE_UNWRITTEN:       return "Nothing Written There";
+		case IMAGE_TOO_LARGE:       return "Image Too Large";
+		case IMAGE_FILE_ERROR:      return "File Error";
+		default:                    return "???";
+	}
+}
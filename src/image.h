@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "buffer.h"
+
+#define IMAGE_INITIAL_CAPACITY 16
+
+typedef enum {
+	IMAGE_OK,
+	IMAGE_ALLOC_FAILED,
+	IMAGE_OVERLAP,
+	IMAGE_UNWRITTEN,
+	IMAGE_TOO_LARGE,
+	IMAGE_FILE_ERROR
+} ImageResult;
+
+// A run of bytes that were written back to back
+typedef struct {
+	uint32_t bank;
+	uint32_t address;
+	ByteBuffer bytes;
+} ImageSegment;
+
+// Sparse output by bank and address, only bytes that were written take up memory
+// Segments are sorted by bank then address and never touch, adjacent writes get merged into one
+typedef struct {
+	ImageSegment* segments;
+	uint32_t count;
+
+	// Segments past count are cleared ones, their buffers get reused by the next writes
+	uint32_t capacity;
+
+	// Where the last write went, writes that follow it don't need a search
+	uint32_t last;
+
+	// Writes may replace bytes that are already there, otherwise that is reported as an overlap
+	uint8_t overwrite;
+
+	ByteBuffer scratch;
+} Image;
+
+ImageResult image_write(Image* image, uint32_t bank, uint32_t address, const uint8_t* data, uint32_t length);
+
+// Replaces bytes that were written before, fills in forward references without counting as an overlap
+ImageResult image_patch(Image* image, uint32_t bank, uint32_t address, const uint8_t* data, uint32_t length);
+
+// Forgets the bytes in the range, a segment that only partly falls in it is cut
+ImageResult image_erase(Image* image, uint32_t bank, uint32_t address, uint32_t length);
+
+// Moves whatever was written in [from, from + length) so it starts at to instead
+ImageResult image_move(Image* image, uint32_t bank, uint32_t from, uint32_t length, uint32_t to);
+
+// Bytes that were actually written, gaps don't count
+uint64_t image_written_size(const Image* image);
+
+// Banks are laid out one after another, bankSize apart, with zeroes between segments and nothing after the last
+uint64_t image_flat_size(const Image* image, uint64_t bankSize);
+ImageResult image_flatten(const Image* image, uint64_t bankSize, ByteBuffer* output);
+
+// Writes the flat layout in one go, gaps are seeked over instead of written where the os allows it
+ImageResult image_save(const Image* image, uint64_t bankSize, const char* path);
+
+// Writes a single bank from address 0 up to its last byte
+ImageResult image_save_bank(const Image* image, uint32_t bank, const char* path);
+
+void image_clear(Image* image);
+void image_dispose(Image* image);
+
+const char* get_image_result_msg(ImageResult result);
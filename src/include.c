@@ -0,0 +1,329 @@
+#include "include.h"
+#include "lexer.h"
+#include "source.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#define INCLUDE_INITIAL_SLOTS 32
+
+static uint32_t hash_path(const char* path) {
+	uint32_t hash = 2166136261u;
+	for (; *path; path++)
+		hash = (hash ^ (uint8_t)*path) * 16777619u;
+
+	return hash;
+}
+
+static uint64_t hash_contents(const char* data, uint32_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t i = 0; i < length; i++)
+		hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+// Nanoseconds where the os has them, a file rewritten within the same second still looks changed
+static uint8_t stat_file(const char* path, int64_t* modified, uint64_t* size) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path, &info) != 0)
+		return 1;
+
+	*modified = (int64_t)info.st_mtime * 1000000000;
+#else
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return 1;
+
+#ifdef __APPLE__
+	*modified = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	*modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+
+	*size = (uint64_t)info.st_size;
+	return 0;
+}
+
+static void free_file(IncludeFile* file) {
+	token_stream_dispose(&file->tokens);
+	free(file->source);
+	free(file->path);
+	free(file);
+}
+
+// Copies the contents, the tokens must not change when the file does
+static IncludeResult read_file(const char* path, char** data, uint32_t* length) {
+	SourceFile source = { 0 };
+
+	switch (source_open(path, &source)) {
+		case SOURCE_OK:             break;
+		case SOURCE_ALLOC_FAILED:   return INCLUDE_ALLOC_FAILED;
+		default:                    return INCLUDE_OPEN_FAILED;
+	}
+
+	*length = (uint32_t)source.length;
+	*data = malloc(source.length ? source.length : 1);
+
+	if (*data != NULL)
+		memcpy(*data, source.data, source.length);
+
+	source_close(&source);
+	return *data != NULL ? INCLUDE_OK : INCLUDE_ALLOC_FAILED;
+}
+
+static IncludeResult load_file(const char* path, uint32_t pathHash, int64_t modified, uint64_t size, IncludeFile** loaded) {
+	IncludeFile* file = calloc(1, sizeof(IncludeFile));
+	if (file == NULL)
+		return INCLUDE_ALLOC_FAILED;
+
+	size_t pathLength = strlen(path);
+	file->path = malloc(pathLength + 1);
+	file->pathHash = pathHash;
+	file->modified = modified;
+	file->size = size;
+
+	if (file->path == NULL || token_stream_init(&file->tokens) != TOKEN_STREAM_OK) {
+		free_file(file);
+		return INCLUDE_ALLOC_FAILED;
+	}
+
+	memcpy(file->path, path, pathLength + 1);
+
+	IncludeResult result = read_file(path, &file->source, &file->length);
+	if (result != INCLUDE_OK) {
+		free_file(file);
+		return result;
+	}
+
+	file->hash = hash_contents(file->source, file->length);
+
+	switch (lex(file->source, file->length, &file->tokens)) {
+		case LEXER_OK:              break;
+		case LEXER_ALLOC_FAILED:    free_file(file); return INCLUDE_ALLOC_FAILED;
+		default:                    free_file(file); return INCLUDE_LEX_FAILED;
+	}
+
+	*loaded = file;
+	return INCLUDE_OK;
+}
+
+// A file with a new modification time or size only gets lexed again when its contents really differ
+static IncludeResult refresh_file(IncludeCache* cache, uint32_t index, int64_t modified, uint64_t size) {
+	IncludeFile* file = cache->files[index];
+
+	char* data;
+	uint32_t length;
+	IncludeResult result = read_file(file->path, &data, &length);
+	if (result != INCLUDE_OK)
+		return result;
+
+	uint8_t same = length == file->length && hash_contents(data, length) == file->hash && memcmp(data, file->source, length) == 0;
+	free(data);
+
+	if (same) {
+		file->modified = modified;
+		file->size = size;
+		cache->hits++;
+		return INCLUDE_OK;
+	}
+
+	IncludeFile* loaded;
+	if ((result = load_file(file->path, file->pathHash, modified, size, &loaded)) != INCLUDE_OK)
+		return result;
+
+	// Builds that still parse the old tokens keep them until they release it
+	file->replaced = 1;
+	if (file->users == 0)
+		free_file(file);
+
+	cache->files[index] = loaded;
+	cache->misses++;
+	return INCLUDE_OK;
+}
+
+// Same as the symbol table, growing rehashes the indices with the hashes the files already have
+static IncludeResult grow_slots(IncludeCache* cache, uint32_t slotCount) {
+	uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+	if (slots == NULL)
+		return INCLUDE_ALLOC_FAILED;
+
+	uint32_t mask = slotCount - 1;
+	for (uint32_t i = 0; i < cache->count; i++) {
+		uint32_t slot = cache->files[i]->pathHash & mask;
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+
+		slots[slot] = i + 1;
+	}
+
+	free(cache->slots);
+	cache->slots = slots;
+	cache->mask = mask;
+
+	return INCLUDE_OK;
+}
+
+// The slot of path, or the empty one it would go in
+static uint32_t find_slot(const IncludeCache* cache, const char* path, uint32_t pathHash) {
+	uint32_t slot = pathHash & cache->mask;
+
+	while (cache->slots[slot] != 0) {
+		const IncludeFile* file = cache->files[cache->slots[slot] - 1];
+		if (file->pathHash == pathHash && strcmp(file->path, path) == 0)
+			return slot;
+
+		slot = (slot + 1) & cache->mask;
+	}
+
+	return slot;
+}
+
+static IncludeResult add_file(IncludeCache* cache, const char* path, uint32_t pathHash, int64_t modified, uint64_t size) {
+	// Grown before the file goes in, so the slots are never more than half full
+	if ((cache->count + 1) * 2 > cache->mask + 1 && grow_slots(cache, (cache->mask + 1) * 2) != INCLUDE_OK)
+		return INCLUDE_ALLOC_FAILED;
+
+	uint32_t slot = find_slot(cache, path, pathHash);
+
+	if (cache->count >= cache->capacity) {
+		uint32_t grown = cache->capacity ? cache->capacity * 2 : 16;
+		IncludeFile** files = realloc(cache->files, sizeof(IncludeFile*) * grown);
+		if (files == NULL)
+			return INCLUDE_ALLOC_FAILED;
+
+		cache->files = files;
+		cache->capacity = grown;
+	}
+
+	IncludeResult result = load_file(path, pathHash, modified, size, &cache->files[cache->count]);
+	if (result != INCLUDE_OK)
+		return result;
+
+	cache->slots[slot] = ++cache->count;
+	cache->misses++;
+	return INCLUDE_OK;
+}
+
+static IncludeResult acquire_locked(IncludeCache* cache, const char* path, uint32_t pathHash, int64_t modified, uint64_t size, IncludeFile** file) {
+	if (cache->slots == NULL && grow_slots(cache, INCLUDE_INITIAL_SLOTS) != INCLUDE_OK)
+		return INCLUDE_ALLOC_FAILED;
+
+	uint32_t slot = find_slot(cache, path, pathHash);
+
+	if (cache->slots[slot] != 0) {
+		uint32_t index = cache->slots[slot] - 1;
+		IncludeFile* cached = cache->files[index];
+
+		if (cached->modified == modified && cached->size == size) {
+			cache->hits++;
+		}
+		else {
+			IncludeResult result = refresh_file(cache, index, modified, size);
+			if (result != INCLUDE_OK)
+				return result;
+		}
+
+		*file = cache->files[index];
+		return INCLUDE_OK;
+	}
+
+	IncludeResult result = add_file(cache, path, pathHash, modified, size);
+	if (result != INCLUDE_OK)
+		return result;
+
+	*file = cache->files[cache->count - 1];
+	return INCLUDE_OK;
+}
+
+void include_cache_init(IncludeCache* cache) {
+	memset(cache, 0, sizeof(IncludeCache));
+	mutex_init(&cache->lock);
+}
+
+IncludeResult include_cache_acquire(IncludeCache* cache, const char* path, IncludeFile** file) {
+	// Neither the stat nor the hash need the cache, so they stay out of the lock
+	int64_t modified;
+	uint64_t size;
+	if (stat_file(path, &modified, &size))
+		return INCLUDE_OPEN_FAILED;
+
+	uint32_t pathHash = hash_path(path);
+
+	// A miss lexes under the lock, so a header everyone includes at once still only gets lexed by one of them
+	mutex_lock(&cache->lock);
+
+	IncludeResult result = acquire_locked(cache, path, pathHash, modified, size, file);
+	if (result == INCLUDE_OK)
+		(*file)->users++;
+
+	mutex_unlock(&cache->lock);
+	return result;
+}
+
+void include_cache_release(IncludeCache* cache, IncludeFile* file) {
+	mutex_lock(&cache->lock);
+
+	file->users--;
+	if (file->replaced && file->users == 0)
+		free_file(file);
+
+	mutex_unlock(&cache->lock);
+}
+
+void include_cache_dispose(IncludeCache* cache) {
+	for (uint32_t i = 0; i < cache->count; i++)
+		free_file(cache->files[i]);
+
+	free(cache->files);
+	free(cache->slots);
+	mutex_dispose(&cache->lock);
+
+	cache->files = NULL;
+	cache->count = 0;
+	cache->capacity = 0;
+	cache->slots = NULL;
+	cache->mask = 0;
+}
+
+IncludeResult include_resolve_path(const char* base, const char* name, uint16_t length, char* output, size_t size) {
+	uint8_t absolute = length > 0 && (name[0] == '/' || name[0] == '\\');
+#ifdef _WIN32
+	absolute |= length > 1 && name[1] == ':';
+#endif
+
+	// Everything up to and including the last separator of base
+	size_t directory = 0;
+	if (base != NULL && !absolute) {
+		for (size_t i = strlen(base); i > 0; i--) {
+			if (base[i - 1] == '/' || base[i - 1] == '\\') {
+				directory = i;
+				break;
+			}
+		}
+	}
+
+	if (directory + length + 1 > size)
+		return INCLUDE_PATH_TOO_LONG;
+
+	if (directory > 0)
+		memcpy(output, base, directory);
+
+	memcpy(&output[directory], name, length);
+	output[directory + length] = '\0';
+
+	return INCLUDE_OK;
+}
+
+const char* get_include_result_msg(IncludeResult result) {
+	switch (result) {
+		case INCLUDE_OK:            return "OK";
+		case INCLUDE_ALLOC_FAILED:  return "Allocation Failed";
+		case INCLUDE_OPEN_FAILED:   return "Could Not Open File";
+		case INCLUDE_PATH_TOO_LONG: return "Path Too Long";
+		case INCLUDE_LEX_FAILED:    return "Could Not Tokenize File";
+		default:                    return "???";
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "libkasm.h"
+#include "thread.h"
+
+// Longest path an include resolves to
+#define INCLUDE_MAX_PATH 1024
+
+typedef enum {
+	INCLUDE_OK,
+	INCLUDE_ALLOC_FAILED,
+	INCLUDE_OPEN_FAILED,
+	INCLUDE_PATH_TOO_LONG,
+	INCLUDE_LEX_FAILED
+} IncludeResult;
+
+// An included file, lexed once and handed to every build that includes it until it changes on disk
+typedef struct {
+	char* path;
+	uint32_t pathHash;
+
+	// What the file looked like when it was read, a change to either has it looked at again
+	int64_t modified;
+	uint64_t size;
+
+	// Hash of the contents, a file that was only touched keeps its tokens
+	uint64_t hash;
+
+	// Own copy of the text, the tokens are spans into it
+	char* source;
+	uint32_t length;
+	TokenStream tokens;
+
+	// Parses using the tokens right now, a file that got replaced is freed once the last one is done
+	uint32_t users;
+	uint8_t replaced;
+} IncludeFile;
+
+// Included files by path, safe to share between builds on any number of threads and contexts
+struct IncludeCache {
+	IncludeFile** files;
+	uint32_t count;
+	uint32_t capacity;
+
+	// Hashes a path to its index in files + 1 (0 is empty), at most half full
+	uint32_t* slots;
+	uint32_t mask;
+
+	Mutex lock;
+
+	// Includes that were answered from the cache and ones that had to be lexed
+	uint64_t hits;
+	uint64_t misses;
+};
+
+void include_cache_init(IncludeCache* cache);
+
+// Hands out the tokens of the file at path, only lexing it when it is new or changed since the last time
+// The file stays valid until it is released, no matter what happens to the cache in the meantime
+IncludeResult include_cache_acquire(IncludeCache* cache, const char* path, IncludeFile** file);
+void include_cache_release(IncludeCache* cache, IncludeFile* file);
+
+// Files still acquired at this point are freed all the same
+void include_cache_dispose(IncludeCache* cache);
+
+// Includes are relative to the file that includes them, base is NULL for a source that came from memory
+// Writes the path of name to output, fails with INCLUDE_PATH_TOO_LONG when it doesn't fit
+IncludeResult include_resolve_path(const char* base, const char* name, uint16_t length, char* output, size_t size);
+
+const char* get_include_result_msg(IncludeResult result);
@@ -1,158 +1,235 @@
 #include "lexer.h"
 
 #include <string.h>
-//#include "opcodes.h"
+#include "thread.h"
 
-LexerResult parse_token(TokenizerContext* context) {
-    Token* token = malloc(sizeof(Token));
-    
-    token->line = context->line;
-    token->position = context->tokenPosition;
-    token->length = context->tokenBufferLength;
-    
-    token->value = malloc(token->length + 1);
-    if (token->value == NULL) {
-        return LEXER_ALLOC_FAILED;
-    }
-
-    memcpy(token->value, context->tokenBuffer, token->length);
-    token->value[token->length] = '\0';
+// Classifies the span and appends it to the stream
+LexerResult parse_token(TokenizerContext* context, uint32_t start, uint32_t end) {
+    uint32_t length = end - start;
+    if (length > TOKEN_MAX_LENGTH)
+        return LEXER_TOKEN_OVERFLOW;
 
     KasmTokenType type;
-    if (parse_token_type(context->tokenBuffer, context->tokenBufferLength, &type) == 1)
-    {
-        context->errToken = token;
+    if (parse_token_type(&context->source[start], length, &type) == 1) {
+        // Keep the offending token around so the caller can report where it was
+        token_stream_push(context->tokens, TOKEN_UNKNOWN, start, length);
         return LEXER_TOKEN_UNKNOWN;
     }
 
-    token->type = type;
-
-    if (list_add(context->tokens, token))
+    if (token_stream_push(context->tokens, type, start, length))
         return LEXER_ALLOC_FAILED;
 
-    memset(context->tokenBuffer, 0, TOKEN_BUFFER_SIZE);
-    context->tokenBufferLength = 0;
+    return LEXER_OK;
+}
+
+// Passes a finished line on and starts the next one from an empty stream
+static LexerResult end_line(TokenizerContext* context) {
+    if (context->on_line == NULL)
+        return LEXER_OK;
 
+    if (context->on_line(context->tokens, context->user))
+        return LEXER_LINE_REJECTED;
+
+    token_stream_clear(context->tokens);
     return LEXER_OK;
 }
 
+// Only delimiters go through the switch, token and comment bodies are skipped by the scanner in one go
 LexerResult tokenize_buffer(TokenizerContext* context) {
-    for (int i = 0; i < context->fileBufferLength; i++) {
+    const char* source = context->source;
+    uint32_t length = context->length;
+    uint32_t i = context->start;
+
+    while (i < length) {
         LexerResult result = LEXER_OK;
-        char chr = context->fileBuffer[i];
-        switch (chr) {
+        switch (source[i]) {
             case ';':
-                context->inComment = 1;
-                
-                if (context->tokenBufferLength == 0)
-                    break;
-
-                result = parse_token(context);
-                break;
+                // Leave i on the new line so it still produces its EOL token
+                i = context->scanner->find_newline(source, i + 1, length);
+                continue;
 
             case '\t':
+            case '\r':
             case ' ':
-                if (context->tokenBufferLength == 0)
-                    break;
-
-                if ((result = parse_token(context)) != LEXER_OK)
-                    break;
-
-                context->position++;
-                context->tokenPosition = context->position;
                 break;
 
-            case '\n': {
-                if (context->inComment) {
-                    context->inComment = 0;
-                }
-                else if (context->tokenBufferLength > 0) {
-                    LexerResult result;
-                    if ((result = parse_token(context)) != LEXER_OK)
-                        break;
-                }
-
-                Token* token = malloc(sizeof(Token));
-
-                if (token == NULL) {
+            case '\n':
+                if (token_stream_push(context->tokens, TOKEN_EOL, i, 1))
                     result = LEXER_ALLOC_FAILED;
-                    break;
-                }
-
-                *token = create_eol_token(context->line, context->position);
-                list_add(context->tokens, token);
-
-                context->line++;
-                context->position = 0;
-                context->tokenPosition = 0;
+                else
+                    result = end_line(context);
                 break;
-            }
-
-            case ',': {
-                if (context->tokenBufferLength > 0) {
-                    if ((result = parse_token(context)) != LEXER_OK)
-                        break;
-                }
 
-                Token* token = malloc(sizeof(Token));
-
-                if (token == NULL) {
+            case ',':
+                if (token_stream_push(context->tokens, TOKEN_COMMA, i, 1))
                     result = LEXER_ALLOC_FAILED;
-                    break;
-                }
-
-                *token = create_comma_token(context->line, context->position);
-                list_add(context->tokens, token);
-
-                context->tokenPosition = context->position + 1;
-                context->position++;
                 break;
-            }
 
-            default:
-                if (context->inComment)
-                    break;
+            default: {
+                uint32_t start = i;
+                i = context->scanner->find_delimiter(source, i + 1, length);
 
-                if (context->tokenBufferLength + 1 >= TOKEN_BUFFER_SIZE) {
-                    result = LEXER_TOKEN_OVERFLOW;
-                    break;
-                }
+                if ((result = parse_token(context, start, i)) != LEXER_OK)
+                    return result;
 
-                context->tokenBuffer[context->tokenBufferLength++] = chr;
-                context->position++;
-                break;
+                continue;
+            }
         }
 
         // Return if an error
         if (result != LEXER_OK)
             return result;
+
+        i++;
     }
 
     return LEXER_OK;
 }
 
-LexerResult lex(FILE* stream, List* tokens) {
+LexerResult lex_lines(const char* source, uint32_t length, TokenStream* tokens, LineHandler handler, void* user) {
     TokenizerContext context = { 0 };
-    //init_token_list(&context.tokens);
 
     context.tokens = tokens;
+    context.scanner = scan_get_scanner();
+    context.source = source;
+    context.length = length;
+    context.on_line = handler;
+    context.user = user;
 
-    size_t bytesRead;
-    while ((bytesRead = fread(context.fileBuffer, 1, FILE_BUFFER_SIZE, stream)) > 0) {
-        LexerResult result;
+    tokens->source = source;
 
-        context.fileBufferLength = bytesRead;
+    LexerResult result;
+    if ((result = tokenize_buffer(&context)) != LEXER_OK)
+        return result;
 
-        if((result = tokenize_buffer(&context)) != LEXER_OK)
-            return result;
-    }
+    // Close off the last line when the source doesn't end on a new line
+    if (tokens->count > 0 && tokens->types[tokens->count - 1] != TOKEN_EOL) {
+        if (token_stream_push(tokens, TOKEN_EOL, length, 0))
+            return LEXER_ALLOC_FAILED;
 
-    if (ferror(stream))
-        return LEXER_STREAM_ERROR;
+        return end_line(&context);
+    }
     
     return LEXER_OK;
 }
 
+LexerResult lex(const char* source, uint32_t length, TokenStream* tokens) {
+    return lex_lines(source, length, tokens, NULL, NULL);
+}
+
+// Chunks smaller than this aren't worth a thread
+#define LEX_PARALLEL_MIN_CHUNK (256 * 1024)
+#define LEX_PARALLEL_MAX_THREADS 64
+
+typedef struct {
+    TokenizerContext context;
+    TokenStream stream;
+
+    LexerResult result;
+} LexChunk;
+
+static void lex_chunk(void* user) {
+    LexChunk* chunk = user;
+    chunk->result = tokenize_buffer(&chunk->context);
+}
+
+LexerResult lex_parallel(const char* source, uint32_t length, TokenStream* tokens, uint32_t threadCount) {
+    if (threadCount > LEX_PARALLEL_MAX_THREADS)
+        threadCount = LEX_PARALLEL_MAX_THREADS;
+
+    if (threadCount > length / LEX_PARALLEL_MIN_CHUNK)
+        threadCount = length / LEX_PARALLEL_MIN_CHUNK;
+
+    if (threadCount <= 1)
+        return lex(source, length, tokens);
+
+    LexChunk chunks[LEX_PARALLEL_MAX_THREADS];
+    Thread threads[LEX_PARALLEL_MAX_THREADS];
+
+    const Scanner* scanner = scan_get_scanner();
+    tokens->source = source;
+
+    // Cut right after a new line, no token or comment crosses one so every chunk lexes on its own
+    uint32_t chunkCount = 0;
+    uint32_t start = 0;
+
+    while (start < length && chunkCount < threadCount) {
+        uint32_t end = length;
+
+        if (chunkCount + 1 < threadCount) {
+            uint32_t target = (uint32_t)(((uint64_t)length * (chunkCount + 1)) / threadCount);
+            if (target < start)
+                target = start;
+
+            end = scanner->find_newline(source, target, length);
+            end = end < length ? end + 1 : length;
+        }
+
+        LexChunk* chunk = &chunks[chunkCount++];
+        memset(chunk, 0, sizeof(LexChunk));
+
+        chunk->context.tokens = chunkCount == 1 ? tokens : &chunk->stream;
+        chunk->context.scanner = scanner;
+        chunk->context.source = source;
+        chunk->context.start = start;
+        chunk->context.length = end;
+        chunk->stream.source = source;
+
+        start = end;
+    }
+
+    // The first chunk goes straight into the output on this thread, the rest get a stream and a thread of their own
+    uint32_t started = 1;
+    for (; started < chunkCount; started++) {
+        if (token_stream_init(&chunks[started].stream) != TOKEN_STREAM_OK)
+            break;
+
+        chunks[started].stream.source = source;
+
+        if (thread_create(&threads[started], lex_chunk, &chunks[started]) != THREAD_OK) {
+            token_stream_dispose(&chunks[started].stream);
+            break;
+        }
+    }
+
+    lex_chunk(&chunks[0]);
+
+    for (uint32_t i = 1; i < started; i++)
+        thread_join(&threads[i]);
+
+    // Stitch them back together in order, stopping where the sequential lexer would have
+    LexerResult result = chunks[0].result;
+
+    for (uint32_t i = 1; i < chunkCount; i++) {
+        if (i < started) {
+            if (result == LEXER_OK && token_stream_append(tokens, &chunks[i].stream) != TOKEN_STREAM_OK)
+                result = LEXER_ALLOC_FAILED;
+
+            if (result == LEXER_OK)
+                result = chunks[i].result;
+
+            token_stream_dispose(&chunks[i].stream);
+        }
+        else if (result == LEXER_OK) {
+            // We couldn't get a thread for this one, so it goes straight onto the end here
+            chunks[i].context.tokens = tokens;
+            lex_chunk(&chunks[i]);
+            result = chunks[i].result;
+        }
+    }
+
+    if (result != LEXER_OK)
+        return result;
+
+    // Close off the last line when the source doesn't end on a new line
+    if (tokens->count > 0 && tokens->types[tokens->count - 1] != TOKEN_EOL) {
+        if (token_stream_push(tokens, TOKEN_EOL, length, 0))
+            return LEXER_ALLOC_FAILED;
+    }
+
+    return LEXER_OK;
+}
+
 const char* get_lexer_result_msg(LexerResult result) {
     switch (result) {
     case LEXER_OK:              return "OK";
@@ -160,6 +237,7 @@ const char* get_lexer_result_msg(LexerResult result) {
     case LEXER_TOKEN_UNKNOWN:   return "Unknown Token";
     case LEXER_ALLOC_FAILED:    return "Allocation Failed";
     case LEXER_STREAM_ERROR:    return "Stream Error";
+    case LEXER_LINE_REJECTED:   return "Line Rejected";
     default:                    return "???";
     }
 }
\ No newline at end of file
@@ -1,36 +1,48 @@
 #pragma once
 
 #include "libkasm.h"
-#include "list.h"
+#include "tokens.h"
+#include "scan.h"
 
 typedef enum {
     LEXER_OK,
     LEXER_TOKEN_OVERFLOW,
     LEXER_TOKEN_UNKNOWN,      
     LEXER_ALLOC_FAILED,
-    LEXER_STREAM_ERROR
+    LEXER_STREAM_ERROR,
+    LEXER_LINE_REJECTED
 } LexerResult;
 
+// Gets every completed line, end of line token included, the stream is cleared once it returns
+// Anything but 0 stops the lexer, the stream is left as it was so the caller can report on it
+typedef uint8_t(*LineHandler)(TokenStream* tokens, void* user);
+
 typedef struct {
-    List* tokens;
+    TokenStream* tokens;
 
-    char fileBuffer[FILE_BUFFER_SIZE];
-    uint8_t fileBufferLength;
+    const Scanner* scanner;
 
-    char tokenBuffer[TOKEN_BUFFER_SIZE];
-    uint8_t tokenBufferLength;
+    const char* source;
+    uint32_t length;
 
-    uint32_t line;
-    uint32_t position;
+    // Where tokenizing starts, offsets stay relative to source so chunks can be lexed on their own
+    uint32_t start;
 
-    uint32_t tokenPosition;
+    // Optional, without one every token stays in the stream
+    LineHandler on_line;
+    void* user;
+} TokenizerContext;
 
-    uint8_t inComment;
-    char lastChar;
+// Tokenizes the source in place, the tokens are spans into it so it has to outlive the stream
+// On an unknown token the last token of the stream is the offending one
+LexerResult lex(const char* source, uint32_t length, TokenStream* tokens);
 
-    Token* errToken;
-} TokenizerContext;
+// Same result as lex, but the source is split at new lines and the chunks are tokenized on up to threadCount threads
+// Small sources, or a threadCount of 1, just go through lex
+LexerResult lex_parallel(const char* source, uint32_t length, TokenStream* tokens, uint32_t threadCount);
 
-LexerResult lex(FILE* stream, List* tokens);
+// Same as lex, but hands each line to the handler as soon as it is complete and reuses the stream for the next
+// The stream never holds more than the longest line, no matter how big the source is
+LexerResult lex_lines(const char* source, uint32_t length, TokenStream* tokens, LineHandler handler, void* user);
 
-const char* get_lexer_result_msg(LexerResult result);
\ No newline at end of file
+const char* get_lexer_result_msg(LexerResult result);
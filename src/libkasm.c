@@ -2,29 +2,33 @@
 
 #include <string.h>
 #include "lexer.h"
-//#include "parser.h"
+#include "parser.h"
+#include "opcode.h"
+#include "assembler.h"
+#include "thread.h"
+#include "stats.h"
+#include "object.h"
 //#include "assembler.h"
-//#include "opcodes.h"
 
 
 // Lexer Func
 // Checks if the token is a label definition (e.g., "@start:")
-static uint8_t parse_label_def(char* token, uint8_t length) {
-    return (token[0] == '@' && token[length - 1] == ':');
+static uint8_t parse_label_def(const char* token, uint16_t length) {
+    return (length > 2 && token[0] == '@' && token[length - 1] == ':');
 }
 
 // Checks if the token is a label reference (e.g., "@start")
-static uint8_t parse_label_ref(char* token, uint8_t length) {
-    return (token[0] == '@');
+static uint8_t parse_label_ref(const char* token, uint16_t length) {
+    return (length > 1 && token[0] == '@');
 }
 
 // Checks if the token is a directive (e.g., ".data", ".text")
-static uint8_t parse_directive(char* token, uint8_t length) {
-    return (token[0] == '.');
+static uint8_t parse_directive(const char* token, uint16_t length) {
+    return (length > 1 && token[0] == '.');
 }
 
 // Checks if the token is a valid instruction (matches an opcode)
-static uint8_t parse_instruction(char* token, uint8_t length) {
+static uint8_t parse_instruction(const char* token, uint16_t length) {
     for (int i = 0; i < length; i++) {
         // We enable the 6th bit here, to set the string to lower, we then check if it falls
         // inbetween the range for a-z, if so we continue, if not we return 0
@@ -38,7 +42,7 @@ static uint8_t parse_instruction(char* token, uint8_t length) {
 }
 
 // Number parsing helper
-static uint8_t parse_number(char* token, uint8_t length, uint8_t isHexadecimal) {
+static uint8_t parse_number(const char* token, uint16_t length, uint8_t isHexadecimal) {
     for (int i = 0; i < length; i++) {
         char chr = token[i] | 0x20;
         if (!((chr >= '0' && chr <= '9') || (chr >= 'a' && chr <= 'f' && isHexadecimal))) {
@@ -49,7 +53,9 @@ static uint8_t parse_number(char* token, uint8_t length, uint8_t isHexadecimal)
 }
 
 // Checks if the token is a valid register (e.g., r0, r1, ..., r5)
-static uint8_t parse_register(char* token, uint8_t length) {
+static uint8_t parse_register(const char* token, uint16_t length) {
+    if (length < 2)
+        return 0;
 
     if (token[0] == 'p' && token[1] == 'c' && length == 2) {
         return 1;
@@ -65,12 +71,12 @@ static uint8_t parse_register(char* token, uint8_t length) {
 }
 
 // Checks if the token represents an immediate value (e.g., #10, #0xFF)
-static uint8_t parse_immediate(char* token, uint8_t length) {
-    if(token[0] != '#') {
+static uint8_t parse_immediate(const char* token, uint16_t length) {
+    if(length < 2 || token[0] != '#') {
         return 0;
     }
     
-    if (token[1] == '0' && (token[2] | 0x20) == 'x') { // Hex
+    if (length > 3 && token[1] == '0' && (token[2] | 0x20) == 'x') { // Hex
         return parse_number(&token[3], length - 3, 1);
     }
     else {
@@ -80,7 +86,7 @@ static uint8_t parse_immediate(char* token, uint8_t length) {
 }
 
 // Checks if the token represents an address (e.g., $1000, $FF)
-static uint8_t parse_address(char* token, uint8_t length) {
+static uint8_t parse_address(const char* token, uint16_t length) {
     // Needs at least "$0x0" = 4 chars
     if (length < 4) return 0;
 
@@ -93,18 +99,18 @@ static uint8_t parse_address(char* token, uint8_t length) {
 }
 
 // Checks if the token is a comma (used to separate operands)
-static uint8_t parse_comma(char* token, uint8_t length) {
+static uint8_t parse_comma(const char* token, uint16_t length) {
     return (token[0] == ',' && length == 1);
 }
 
 // Checks if the token is an end-of-line (newline character '\n')
-static uint8_t parse_eol(char* token, uint8_t length) {
+static uint8_t parse_eol(const char* token, uint16_t length) {
     return (token[0] == '\n' && length == 1);
 }
 
 // Parse string
-static uint8_t parse_string(char* token, uint8_t length) {
-    return (token[0] == '"' && token[length - 1] == '"');
+static uint8_t parse_string(const char* token, uint16_t length) {
+    return (length > 1 && token[0] == '"' && token[length - 1] == '"');
 }
 
 static TokenTypeDef gTokenTypes[] = {
@@ -113,22 +119,63 @@ static TokenTypeDef gTokenTypes[] = {
     [TOKEN_INSTRUCTION] = { parse_instruction, TOKEN_FLAG_ACTION, TOKEN_FLAG_EOL,                       TOKEN_FLAG_VALUE | TOKEN_FLAG_EOL },
     [TOKEN_REGISTER]    = { parse_register,    TOKEN_FLAG_VALUE,  TOKEN_FLAG_ACTION | TOKEN_FLAG_COMMA, TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL },
     [TOKEN_IMMEDIATE]   = { parse_immediate,   TOKEN_FLAG_VALUE,  TOKEN_FLAG_ACTION | TOKEN_FLAG_COMMA, TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL },
-    [TOKEN_ADDRESS]     = { parse_immediate,   TOKEN_FLAG_VALUE,  TOKEN_FLAG_ACTION | TOKEN_FLAG_COMMA, TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL },
+    [TOKEN_ADDRESS]     = { parse_address,     TOKEN_FLAG_VALUE,  TOKEN_FLAG_ACTION | TOKEN_FLAG_COMMA, TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL },
     [TOKEN_LABEL_REF]   = { parse_label_ref,   TOKEN_FLAG_VALUE,  TOKEN_FLAG_ACTION | TOKEN_FLAG_COMMA, TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL },
-    [TOKEN_COMMA]       = { parse_comma,       TOKEN_FLAG_COMMA,  TOKEN_FLAG_VALUE,                     TOKEN_FLAG_VALUE },
-    [TOKEN_STRING]      = { parse_string,      TOKEN_FLAG_STRING, TOKEN_FLAG_ACTION,                    TOKEN_FLAG_EOL},
-    [TOKEN_EOL]         = { parse_eol,         TOKEN_FLAG_EOL,    0b111011 /* all but comma */,         TOKEN_FLAG_LABEL | TOKEN_FLAG_ACTION | TOKEN_FLAG_EOL }
+    [TOKEN_COMMA]       = { parse_comma,       TOKEN_FLAG_COMMA,  TOKEN_FLAG_VALUE | TOKEN_FLAG_STRING, TOKEN_FLAG_VALUE },
+    [TOKEN_STRING]      = { parse_string,      TOKEN_FLAG_STRING, TOKEN_FLAG_ACTION,                    TOKEN_FLAG_COMMA | TOKEN_FLAG_EOL},
+    [TOKEN_EOL]         = { parse_eol,         TOKEN_FLAG_EOL,    0b110111 /* all but comma */,         TOKEN_FLAG_LABEL | TOKEN_FLAG_ACTION | TOKEN_FLAG_EOL }
 };
 
-uint8_t parse_token_type(char* value, uint8_t length, KasmTokenType* tokenType) {
-    for (uint8_t i = 1; i < TOKEN_MAX; i++) {
-        if (!gTokenTypes[i].can_parse(value, length))
-            continue;
+// Letters start instructions, 'r', 'p' and 's' might also be a register
+#define LETTER_TYPE(lower, type) [lower] = type, [(lower) - 0x20] = TOKEN_INSTRUCTION
+
+// The first byte of a token decides which validator it goes through, 0 means nothing can start with it
+static const uint8_t gFirstByteTypes[256] = {
+    ['@'] = TOKEN_LABEL_REF, ['.'] = TOKEN_DIRECTIVE, ['#'] = TOKEN_IMMEDIATE, ['$'] = TOKEN_ADDRESS,
+    ['"'] = TOKEN_STRING, [','] = TOKEN_COMMA, ['\n'] = TOKEN_EOL,
+
+    LETTER_TYPE('a', TOKEN_INSTRUCTION), LETTER_TYPE('b', TOKEN_INSTRUCTION), LETTER_TYPE('c', TOKEN_INSTRUCTION),
+    LETTER_TYPE('d', TOKEN_INSTRUCTION), LETTER_TYPE('e', TOKEN_INSTRUCTION), LETTER_TYPE('f', TOKEN_INSTRUCTION),
+    LETTER_TYPE('g', TOKEN_INSTRUCTION), LETTER_TYPE('h', TOKEN_INSTRUCTION), LETTER_TYPE('i', TOKEN_INSTRUCTION),
+    LETTER_TYPE('j', TOKEN_INSTRUCTION), LETTER_TYPE('k', TOKEN_INSTRUCTION), LETTER_TYPE('l', TOKEN_INSTRUCTION),
+    LETTER_TYPE('m', TOKEN_INSTRUCTION), LETTER_TYPE('n', TOKEN_INSTRUCTION), LETTER_TYPE('o', TOKEN_INSTRUCTION),
+    LETTER_TYPE('p', TOKEN_REGISTER),    LETTER_TYPE('q', TOKEN_INSTRUCTION), LETTER_TYPE('r', TOKEN_REGISTER),
+    LETTER_TYPE('s', TOKEN_REGISTER),    LETTER_TYPE('t', TOKEN_INSTRUCTION), LETTER_TYPE('u', TOKEN_INSTRUCTION),
+    LETTER_TYPE('v', TOKEN_INSTRUCTION), LETTER_TYPE('w', TOKEN_INSTRUCTION), LETTER_TYPE('x', TOKEN_INSTRUCTION),
+    LETTER_TYPE('y', TOKEN_INSTRUCTION), LETTER_TYPE('z', TOKEN_INSTRUCTION)
+};
 
-        *tokenType = i;
-        return 0;
+uint8_t parse_token_type(const char* value, uint16_t length, KasmTokenType* tokenType) {
+    if (length == 0)
+        return 1;
+
+    KasmTokenType type = gFirstByteTypes[(uint8_t)value[0]];
+
+    switch (type) {
+        case 0:
+            return 1;
+
+        case TOKEN_LABEL_REF:
+            // Same prefix, only the trailing ':' tells a definition apart
+            if (value[length - 1] == ':')
+                type = TOKEN_LABEL_DEF;
+            break;
+
+        case TOKEN_REGISTER:
+            // "push", "sub", "ret" start the same way as a register
+            if (!parse_register(value, length))
+                type = TOKEN_INSTRUCTION;
+            break;
+
+        default:
+            break;
     }
-    return 1;
+
+    if (!gTokenTypes[type].can_parse(value, length))
+        return 1;
+
+    *tokenType = type;
+    return 0;
 }
 
 TokenTypeDef* get_token_type_def(KasmTokenType type) {
@@ -155,102 +202,590 @@ const char* get_token_type_name(KasmTokenType type) {
 
 // Parser Func
 static DirectiveTypeDef gDirectiveTypes[] = {
-    [DIRECTIVE_ORG]  = { .name = "org",  .serializeArguments = 0 },
-    [DIRECTIVE_BANK] = { .name = "bank", .serializeArguments = 0 },
-    [DIRECTIVE_DB]   = { .name = "db",   .serializeArguments = 1 }
+    [DIRECTIVE_ORG]     = { .name = "org",     .serializeArguments = 0 },
+    [DIRECTIVE_BANK]    = { .name = "bank",    .serializeArguments = 0 },
+    [DIRECTIVE_DB]      = { .name = "db",      .serializeArguments = 1 },
+    [DIRECTIVE_INCLUDE] = { .name = "include", .serializeArguments = 0 },
+    [DIRECTIVE_INCBIN]  = { .name = "incbin",  .serializeArguments = 0 }
 };
 
-uint8_t parse_directive_type(const char* value, DirectiveType* type) {
-    for (uint16_t i = 0; i < DIRECTIVE_MAX; i++) {
-        if(strcmp(value, gDirectiveTypes[i].name)) {
-            continue;
-        }
+// The directive set is fixed, so its hash table is laid out by the compiler
+// Slots hold the directive + 1 so 0 means empty, a new directive must land on a free slot
+#define DIRECTIVE_HASH(first, last, length) ((((first) * 7) + ((last) * 3) + (length)) & 15)
+
+static const uint8_t gDirectiveSlots[16] = {
+    [DIRECTIVE_HASH('o', 'g', 3)] = DIRECTIVE_ORG + 1,
+    [DIRECTIVE_HASH('b', 'k', 4)] = DIRECTIVE_BANK + 1,
+    [DIRECTIVE_HASH('d', 'b', 2)] = DIRECTIVE_DB + 1,
+    [DIRECTIVE_HASH('i', 'e', 7)] = DIRECTIVE_INCLUDE + 1,
+    [DIRECTIVE_HASH('i', 'n', 6)] = DIRECTIVE_INCBIN + 1
+};
 
-        *type = i;
-        return 0;   // Success
+uint8_t parse_directive_type(const char* value, uint16_t length, DirectiveType* type) {
+    if (length == 0) {
+        return 1;
     }
 
-    return 1;
+    uint8_t slot = gDirectiveSlots[DIRECTIVE_HASH((uint8_t)value[0], (uint8_t)value[length - 1], length)];
+    if (slot == 0) {
+        return 1;
+    }
+
+    const char* name = gDirectiveTypes[slot - 1].name;
+    if (strlen(name) != length || memcmp(value, name, length)) {
+        return 1;
+    }
+
+    *type = slot - 1;
+    return 0;   // Success
 }
 
-uint8_t parse_opcode_type(BuildContext* context, char* value, uint16_t* opcodeId) {
-    for (uint16_t i = 0; i < context->target->opcodeCount; i++) {
-        OpcodeDef* opcode = context->target->get_opcode(i);
-        if (opcode->mnemonic == NULL) {
-            continue;
-        }
+uint8_t parse_opcode_type(BuildContext* context, const char* value, uint16_t length, uint16_t* opcodeId) {
+    const OpcodeIndexEntry* entry = opcode_index_find(context->target->opcodeIndex, value, length);
+    if (entry == NULL) {
+        return 1;
+    }
 
-        if (strcmp(value, opcode->mnemonic)) {
-            continue;
-        }
+    *opcodeId = entry->opcode;
+    return 0;
+}
+
+// Picks the exact encoding of a mnemonic for the given operand signature
+uint8_t parse_opcode_signature(BuildContext* context, const char* value, uint16_t length, uint32_t signature, uint16_t* opcodeId) {
+    const OpcodeIndexEntry* entry = opcode_index_resolve(context->target->opcodeIndex, value, length, signature);
+    if (entry == NULL) {
+        return 1;
+    }
+
+    *opcodeId = entry->opcode;
+    return 0;
+}
+
+
+// Target Func
+TargetResult kasm_register_target(BuildTarget* target) {
+    if (target == NULL || target->get_opcode == NULL) {
+        return TARGET_INVALID;
+    }
+
+    if (target->opcodeIndex != NULL) {
+        return target->opcodeIndex->conflictCount ? TARGET_SIGNATURE_CONFLICT : TARGET_OK;
+    }
+
+    // Generated tables are used as they are, unless they were made for another layout
+    if (target->tables != NULL && target->tables->version == OPCODE_INDEX_VERSION) {
+        target->opcodeIndex = target->tables;
+        return target->tables->conflictCount ? TARGET_SIGNATURE_CONFLICT : TARGET_OK;
+    }
+
+    OpcodeIndex* index = calloc(1, sizeof(OpcodeIndex));
+    if (index == NULL) {
+        return TARGET_ALLOC_FAILED;
+    }
+
+    // Conflicts are only a warning, the first opcode of a pair stays usable
+    TargetResult result = opcode_index_build(target, index);
+    if (result > TARGET_SIGNATURE_CONFLICT) {
+        opcode_index_dispose(index);
+        free(index);
+        return result;
+    }
+
+    target->opcodeIndex = index;
+    return result;
+}
+
+void kasm_unregister_target(BuildTarget* target) {
+    if (target->opcodeIndex == NULL) {
+        return;
+    }
 
-        *opcodeId = i;
+    // Only an index built at registration is ours to free
+    if (target->opcodeIndex != target->tables) {
+        OpcodeIndex* index = (OpcodeIndex*)target->opcodeIndex;
+        opcode_index_dispose(index);
+        free(index);
+    }
+
+    target->opcodeIndex = NULL;
+}
+
+uint16_t kasm_get_target_conflicts(const BuildTarget* target, const OpcodeConflict** conflicts) {
+    if (target->opcodeIndex == NULL) {
+        *conflicts = NULL;
         return 0;
     }
 
-    return 1;
+    *conflicts = target->opcodeIndex->conflicts;
+    return target->opcodeIndex->conflictCount;
+}
+
+const char* get_target_result_msg(TargetResult result) {
+    switch (result) {
+    case TARGET_OK:                 return "OK";
+    case TARGET_SIGNATURE_CONFLICT: return "Conflicting Opcode Signatures";
+    case TARGET_ALLOC_FAILED:       return "Allocation Failed";
+    case TARGET_INVALID:            return "Invalid Target";
+    default:                        return "???";
+    }
 }
 
 
 // Build Func
-uint8_t kasm_build(const char* input, const char* output, BuildContext* context) {
-    context->buildState = BUILD_STATE_LOAD_FILE;
-    FILE* file = fopen(input, "r");
-    if (!file) {
-        context->assemblerResult = BUILD_RESULT_FILE_ERROR;
-        return 1;
+static uint8_t lexer_result_to_build_result(LexerResult result) {
+    switch (result) {
+    case LEXER_TOKEN_OVERFLOW:  return BUILD_RESULT_BUFFER_OVERFLOW;
+    case LEXER_TOKEN_UNKNOWN:   return BUILD_RESULT_SYNTAX_ERROR;
+    case LEXER_ALLOC_FAILED:    return BUILD_RESULT_ALLOC_FAILED;
+    case LEXER_STREAM_ERROR:    return BUILD_RESULT_FILE_ERROR;
+    default:                    return BUILD_RESULT_UNKOWN_ERROR;
     }
+}
 
-    // Allocate the list of tokens
-    context->buildState = BUILD_STATE_ALLOC_TOKENS;
+static uint8_t assembler_result_to_build_result(AssemblerResult result) {
+    switch (result) {
+    case ASSEMBLER_OK:              return BUILD_RESULT_SUCCESS;
+    case ASSEMBLER_ALLOC_FAILED:    return BUILD_RESULT_ALLOC_FAILED;
+    default:                        return BUILD_RESULT_ASSEMBLY_ERROR;
+    }
+}
 
-    List tokens = { 0 };
-    list_init(&tokens);
+static uint8_t object_result_to_build_result(ObjectResult result) {
+    switch (result) {
+    case OBJECT_OK:                 return BUILD_RESULT_SUCCESS;
+    case OBJECT_ALLOC_FAILED:       return BUILD_RESULT_ALLOC_FAILED;
+    default:                        return BUILD_RESULT_LINK_ERROR;
+    }
+}
 
-    // Tokenize the stream
-    context->buildState = BUILD_STATE_TOKENIZE;
-    LexerResult result;
-    if ((context->tokenizerResult = lex(file, &tokens)) != LEXER_OK) {
-        switch (context->tokenizerResult) {
-        case LEXER_TOKEN_OVERFLOW:
-            context->assemblerResult = BUILD_RESULT_BUFFER_OVERFLOW;
-            break;
+static uint8_t parser_result_to_build_result(BuildContext* context, ParserResult result) {
+    switch (result) {
+    case PARSER_ALLOC_FAILED:       return BUILD_RESULT_ALLOC_FAILED;
+    case PARSER_ASSEMBLY_FAILED:    return assembler_result_to_build_result(context->assemblyResult);
+    default:                        return BUILD_RESULT_SYNTAX_ERROR;
+    }
+}
 
-        case LEXER_TOKEN_UNKNOWN:
-            context->assemblerResult = BUILD_RESULT_SYNTAX_ERROR;
-            break;
+// Every bank spans the whole address space of the target
+static uint64_t bank_size(const BuildTarget* target) {
+    return target->addressSize < 8 ? (uint64_t)1 << (target->addressSize * 8) : UINT64_MAX;
+}
 
-        case LEXER_ALLOC_FAILED:
-            context->assemblerResult = BUILD_RESULT_ALLOC_FAILED;
-            break;
+// "rom.bin" becomes "rom.bank1.bin", a name without an extension just gets ".bank1" appended
+static char* bank_path(const char* path, uint32_t bank) {
+    size_t length = strlen(path);
+    size_t stem = length;
 
-        case LEXER_STREAM_ERROR:
-            context->assemblerResult = BUILD_RESULT_FILE_ERROR;
+    for (size_t i = length; i > 0; i--) {
+        char c = path[i - 1];
+        if (c == '/' || c == '\\') {
             break;
+        }
 
-        default:
-            context->assemblerResult = BUILD_RESULT_UNKOWN_ERROR;
+        if (c == '.') {
+            stem = i - 1;
             break;
         }
+    }
+
+    char* bankPath = malloc(length + 18);
+    if (bankPath != NULL) {
+        snprintf(bankPath, length + 18, "%.*s.bank%u%s", (int)stem, path, bank, &path[stem]);
+    }
+
+    return bankPath;
+}
+
+static uint8_t write_banks(const Image* image, const char* path) {
+    for (uint32_t i = 0; i < image->count; i++) {
+        uint32_t bank = image->segments[i].bank;
+        if (i > 0 && image->segments[i - 1].bank == bank) {
+            continue;
+        }
+
+        char* bankPath = bank_path(path, bank);
+        if (bankPath == NULL) {
+            return BUILD_RESULT_ALLOC_FAILED;
+        }
+
+        ImageResult result = image_save_bank(image, bank, bankPath);
+        free(bankPath);
+
+        if (result != IMAGE_OK) {
+            return BUILD_RESULT_FILE_ERROR;
+        }
+    }
+
+    return BUILD_RESULT_SUCCESS;
+}
+
+// Objects are serialized into context->output, written out from there when there is a path
+static uint8_t object_output(BuildContext* context, const char* path) {
+    switch (object_write(context, &context->output)) {
+    case BYTE_BUFFER_OK:        break;
+    case BYTE_BUFFER_FULL:      return BUILD_RESULT_BUFFER_OVERFLOW;
+    default:                    return BUILD_RESULT_ALLOC_FAILED;
+    }
+
+    if (path == NULL) {
+        return BUILD_RESULT_SUCCESS;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return BUILD_RESULT_FILE_ERROR;
+    }
+
+    uint8_t failed = fwrite(context->output.data, 1, context->output.length, file) != context->output.length;
+    failed |= fclose(file) != 0;
+
+    return failed ? BUILD_RESULT_FILE_ERROR : BUILD_RESULT_SUCCESS;
+}
+
+static uint8_t write_output(BuildContext* context, const char* path) {
+    if (context->flags & BUILD_FLAG_OBJECT) {
+        return object_output(context, path);
+    }
+
+    if (context->flags & BUILD_FLAG_SPLIT_BANKS) {
+        return write_banks(&context->image, path);
+    }
+
+    return image_save(&context->image, bank_size(context->target), path) == IMAGE_OK ? BUILD_RESULT_SUCCESS : BUILD_RESULT_FILE_ERROR;
+}
+
+static uint8_t flatten_output(BuildContext* context) {
+    if (context->flags & BUILD_FLAG_OBJECT) {
+        return object_output(context, NULL);
+    }
 
-        free(tokens.values);
+    switch (image_flatten(&context->image, bank_size(context->target), &context->output)) {
+    case IMAGE_OK:          return BUILD_RESULT_SUCCESS;
+    case IMAGE_TOO_LARGE:   return BUILD_RESULT_BUFFER_OVERFLOW;
+    default:                return BUILD_RESULT_ALLOC_FAILED;
+    }
+}
+
+// Every state change goes through here, without stats it is just the store
+static inline void enter_state(BuildContext* context, BuildState state) {
+    context->buildState = state;
+
+    if (context->stats != NULL) {
+        stats_enter(context, state);
+    }
+}
+
+// For the changes on every streamed line, only the wall clock gets read there
+static inline void step_state(BuildContext* context, BuildState state) {
+    context->buildState = state;
+
+    if (context->stats != NULL) {
+        stats_step(context, state);
+    }
+}
+
+// Lex everything, then parse, then assemble
+static uint8_t build_whole(BuildContext* context) {
+    // Tokenize the source
+    enter_state(context, BUILD_STATE_TOKENIZE);
+    uint32_t threadCount = (context->flags & BUILD_FLAG_PARALLEL_LEX) ? thread_cpu_count() : 1;
+
+    if ((context->tokenizerResult = lex_parallel(context->source.data, (uint32_t)context->source.length, &context->tokens, threadCount)) != LEXER_OK) {
+        // The lexer leaves the unknown token at the end of the stream
+        context->errorToken = context->tokens.count ? context->tokens.count - 1 : 0;
+        context->errorLine = token_stream_line(&context->tokens, context->errorToken, TOKEN_EOL);
+        return lexer_result_to_build_result(context->tokenizerResult);
+    }
+
+    // Parse the tokens into actions and labels
+    enter_state(context, BUILD_STATE_PARSE_TOKENS);
+    if ((context->parserResult = kasm_parse(context)) != PARSER_OK) {
+        return parser_result_to_build_result(context, context->parserResult);
+    }
+
+    // In single pass mode the parser already encoded everything
+    enter_state(context, BUILD_STATE_ASSEMBLE);
+    if (!(context->flags & BUILD_FLAG_SINGLE_PASS)) {
+        if ((context->assemblyResult = kasm_assemble(context)) != ASSEMBLER_OK) {
+            return assembler_result_to_build_result(context->assemblyResult);
+        }
+    }
+
+    return BUILD_RESULT_SUCCESS;
+}
+
+// Consumed source gets handed back to the os in steps this big
+#define STREAM_RELEASE_INTERVAL (1 << 20)
+
+typedef struct {
+    BuildContext* context;
+    uint32_t released;
+} StreamState;
+
+static uint8_t stream_line(TokenStream* tokens, void* user) {
+    StreamState* state = user;
+    BuildContext* context = state->context;
+
+    step_state(context, BUILD_STATE_PARSE_TOKENS);
+    if ((context->parserResult = kasm_parse_tokens(context)) != PARSER_OK) {
         return 1;
     }
 
-    // Close current file, we need to open a new one for writting :)
-    if (ferror(file)) {
-        free(tokens.values);
-        fclose(file);
+    step_state(context, BUILD_STATE_TOKENIZE);
+    context->lineOffset++;
+
+    // The stream gets cleared after every line, so its tokens are counted here
+    if (context->stats != NULL) {
+        context->stats->tokens += tokens->count;
+    }
+
+    // The line is encoded, nothing before its end of line gets read again
+    uint32_t end = tokens->offsets[tokens->count - 1];
+    if (end - state->released >= STREAM_RELEASE_INTERVAL) {
+        source_release(&context->source, end);
+        state->released = end;
+    }
+
+    return 0;
+}
 
-        context->assemblerResult = BUILD_RESULT_FILE_ERROR;
+// Lex, parse and encode one line at a time, only the unresolved fixups outlive their line
+static uint8_t build_streamed(BuildContext* context) {
+    if ((context->parserResult = kasm_parse_begin(context)) != PARSER_OK) {
+        return parser_result_to_build_result(context, context->parserResult);
+    }
+
+    StreamState state = { context, 0 };
+
+    enter_state(context, BUILD_STATE_TOKENIZE);
+    context->tokenizerResult = lex_lines(context->source.data, (uint32_t)context->source.length, &context->tokens, stream_line, &state);
+
+    if (context->tokenizerResult == LEXER_LINE_REJECTED) {
+        return parser_result_to_build_result(context, context->parserResult);
+    }
+
+    if (context->tokenizerResult != LEXER_OK) {
+        context->errorToken = context->tokens.count ? context->tokens.count - 1 : 0;
+        context->errorLine = context->lineOffset + token_stream_line(&context->tokens, context->errorToken, TOKEN_EOL);
+        return lexer_result_to_build_result(context->tokenizerResult);
+    }
+
+    enter_state(context, BUILD_STATE_PARSE_TOKENS);
+    if ((context->parserResult = kasm_parse_end(context)) != PARSER_OK) {
+        return parser_result_to_build_result(context, context->parserResult);
+    }
+
+    return BUILD_RESULT_SUCCESS;
+}
+
+// Empties everything the build used, the storage itself stays for the next one
+static void clear_scratch(BuildContext* context) {
+    token_stream_clear(&context->tokens);
+    vector_clear(&context->actions);
+
+    for (uint32_t i = 0; i < context->binaries.count; i++) {
+        source_close(VECTOR_AT(&context->binaries, SourceFile, i));
+    }
+
+    vector_clear(&context->binaries);
+
+    if (context->labels.symbols != NULL) {
+        symbol_table_clear(&context->labels);
+    }
+
+    // Pooled fixups live in the arena
+    context->freeFixups = NULL;
+    arena_reset(&context->arena);
+}
+
+static uint8_t end_build(BuildContext* context, uint8_t result) {
+    // Counts come from the tokens and labels, so this goes before they are cleared
+    if (context->stats != NULL) {
+        stats_end(context);
+    }
+
+    // The tokens and actions point into the source and the arena, neither outlives the build
+    source_close(&context->source);
+    context->sourcePath = NULL;
+    clear_scratch(context);
+
+    context->assemblerResult = result;
+    return result != BUILD_RESULT_SUCCESS;
+}
+
+static uint8_t begin_build(BuildContext* context) {
+    // Targets that weren't registered up front get their tables built here
+    if (kasm_register_target(context->target) > TARGET_SIGNATURE_CONFLICT) {
+        context->assemblerResult = BUILD_RESULT_TARGET_ERROR;
         return 1;
     }
 
-    fclose(file);
+    context->buildState = BUILD_STATE_LOAD_FILE;
+
+    if (context->stats != NULL) {
+        stats_begin(context);
+    }
+
+    return 0;
+}
+
+static uint8_t open_failed(BuildContext* context, SourceResult result) {
+    context->sourcePath = NULL;
+
+    if (context->stats != NULL) {
+        stats_end(context);
+    }
+
+    context->assemblerResult = result == SOURCE_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_FILE_ERROR;
+    return 1;
+}
 
-    // Start actually parsing the tokens and writing bytes to a file
+// Runs a build over context->source, which is open by now, output is a file path or NULL to flatten into context->output
+static uint8_t build_source(BuildContext* context, const char* output) {
+    // The previous output stays readable until the next build
+    kasm_context_reset(context);
+
+    // Allocate the token stream, after the first build it is already there
+    enter_state(context, BUILD_STATE_ALLOC_TOKENS);
+
+    if (context->tokens.types == NULL && token_stream_init(&context->tokens) != TOKEN_STREAM_OK) {
+        return end_build(context, BUILD_RESULT_ALLOC_FAILED);
+    }
+
+    uint8_t result = (context->flags & BUILD_FLAG_STREAM) ? build_streamed(context) : build_whole(context);
+    if (result != BUILD_RESULT_SUCCESS) {
+        return end_build(context, result);
+    }
 
     // Finalize
-    context->buildState = BUILD_STATE_FINALIZE;
-    free(tokens.values);
-}
\ No newline at end of file
+    enter_state(context, BUILD_STATE_FINALIZE);
+    result = output != NULL ? write_output(context, output) : flatten_output(context);
+    return end_build(context, result);
+}
+
+uint8_t kasm_build(const char* input, const char* output, BuildContext* context) {
+    if (begin_build(context)) {
+        return 1;
+    }
+
+    // Map the whole file, the lexer works on it in place
+    context->sourcePath = input;
+    SourceResult sourceResult = source_open(input, &context->source);
+    if (sourceResult != SOURCE_OK) {
+        return open_failed(context, sourceResult);
+    }
+
+    return build_source(context, output);
+}
+
+uint8_t kasm_build_buffer(const char* source, uint32_t length, BuildContext* context) {
+    if (begin_build(context)) {
+        return 1;
+    }
+
+    // The lexer reads the caller's memory directly, includes are relative to the working directory
+    context->sourcePath = NULL;
+    SourceResult sourceResult = source_view(source, length, &context->source);
+    if (sourceResult != SOURCE_OK) {
+        return open_failed(context, sourceResult);
+    }
+
+    return build_source(context, NULL);
+}
+
+uint8_t kasm_link(const char* const* inputs, uint32_t count, const char* output, BuildContext* context) {
+    if (begin_build(context)) {
+        return 1;
+    }
+
+    kasm_context_reset(context);
+
+    if (context->labels.symbols == NULL && symbol_table_init(&context->labels) != SYMBOL_OK) {
+        return end_build(context, BUILD_RESULT_ALLOC_FAILED);
+    }
+
+    // Objects are linked in order, a relocation to a label a later object defines waits as a fixup
+    for (uint32_t i = 0; i < count; i++) {
+        context->errorObject = i;
+
+        enter_state(context, BUILD_STATE_LOAD_FILE);
+        SourceResult sourceResult = source_open(inputs[i], &context->source);
+        if (sourceResult != SOURCE_OK) {
+            return end_build(context, sourceResult == SOURCE_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_FILE_ERROR);
+        }
+
+        enter_state(context, BUILD_STATE_ASSEMBLE);
+        context->linkerResult = object_link(context, (const uint8_t*)context->source.data, context->source.length);
+        source_close(&context->source);
+
+        if (context->linkerResult != OBJECT_OK) {
+            return end_build(context, object_result_to_build_result(context->linkerResult));
+        }
+    }
+
+    context->errorObject = count;
+
+    // A partial link leaves what is still undefined to the next one
+    if (!(context->flags & BUILD_FLAG_OBJECT) && (context->linkerResult = object_check_defined(context)) != OBJECT_OK) {
+        return end_build(context, object_result_to_build_result(context->linkerResult));
+    }
+
+    enter_state(context, BUILD_STATE_FINALIZE);
+    uint8_t result = output != NULL ? write_output(context, output) : flatten_output(context);
+    return end_build(context, result);
+}
+
+const char* get_build_result_msg(BuildResult result) {
+    switch (result) {
+    case BUILD_RESULT_SUCCESS:          return "OK";
+    case BUILD_RESULT_FILE_ERROR:       return "File Error";
+    case BUILD_RESULT_SYNTAX_ERROR:     return "Syntax Error";
+    case BUILD_RESULT_ALLOC_FAILED:     return "Allocation Failed";
+    case BUILD_RESULT_BUFFER_OVERFLOW:  return "Buffer Overflow";
+    case BUILD_RESULT_TARGET_ERROR:     return "Target Error";
+    case BUILD_RESULT_ASSEMBLY_ERROR:   return "Assembly Error";
+    case BUILD_RESULT_LINK_ERROR:       return "Link Error";
+    default:                            return "Unknown Error";
+    }
+}
+
+const char* get_build_state_name(BuildState state) {
+    switch (state) {
+    case BUILD_STATE_LOAD_FILE:     return "Load File";
+    case BUILD_STATE_ALLOC_TOKENS:  return "Alloc Tokens";
+    case BUILD_STATE_TOKENIZE:      return "Tokenize";
+    case BUILD_STATE_PARSE_TOKENS:  return "Parse Tokens";
+    case BUILD_STATE_ASSEMBLE:      return "Assemble";
+    case BUILD_STATE_FINALIZE:      return "Finalize";
+    default:                        return "???";
+    }
+}
+
+void kasm_context_reset(BuildContext* context) {
+    clear_scratch(context);
+    image_clear(&context->image);
+    byte_buffer_clear(&context->output);
+
+    context->assemblerResult = BUILD_RESULT_SUCCESS;
+    context->tokenizerResult = 0;
+    context->parserResult = 0;
+    context->assemblyResult = ASSEMBLER_OK;
+    context->linkerResult = OBJECT_OK;
+    context->errorObject = 0;
+    context->errorToken = 0;
+    context->errorLine = 0;
+    context->lineOffset = 0;
+    context->position = 0;
+    context->bank = 0;
+}
+
+void kasm_context_dispose(BuildContext* context) {
+    kasm_parse_dispose(context);
+    token_stream_dispose(&context->tokens);
+    vector_dispose(&context->actions);
+    vector_dispose(&context->binaries);
+    symbol_table_dispose(&context->labels);
+    image_dispose(&context->image);
+    byte_buffer_dispose(&context->output);
+    arena_dispose(&context->arena);
+}
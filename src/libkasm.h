@@ -3,10 +3,19 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include "list.h"
-
-#define FILE_BUFFER_SIZE 1024
-#define TOKEN_BUFFER_SIZE 64
+#include "vector.h"
+#include "arena.h"
+#include "tokens.h"
+#include "source.h"
+#include "symbols.h"
+#include "buffer.h"
+#include "image.h"
+
+#ifdef _WIN32
+#define KASM_EXPORT __declspec(dllexport)
+#else
+#define KASM_EXPORT __attribute__((visibility("default")))
+#endif
 
 // Opcodes
 typedef enum {
@@ -17,10 +26,10 @@ typedef enum {
 } OperandType;
 
 typedef struct {
-    char* mnemonic;
+    const char* mnemonic;
 
     uint8_t operandCount;
-    OperandType* operands;
+    const OperandType* operands;
 } OpcodeDef;
 
 
@@ -49,7 +58,7 @@ typedef enum {
     TOKEN_FLAG_EOL    = 0b00100000
 } TokenTypeFlag;
 
-typedef uint8_t(*TokenHandler)(char* token, uint8_t length);
+typedef uint8_t(*TokenHandler)(const char* token, uint16_t length);
 
 typedef struct {
     TokenHandler can_parse;
@@ -60,38 +69,6 @@ typedef struct {
     uint8_t succeedingFlag;
 } TokenTypeDef;
 
-typedef struct {
-    uint8_t type;
-
-    char* value;
-    uint8_t length;
-
-    uint32_t line;
-    uint32_t position;
-} Token;
-
-
-// Lexer helpers
-static inline Token create_eol_token(uint32_t line, uint32_t position) {
-    char value[TOKEN_BUFFER_SIZE] = {
-        [0] = '\n'
-    };
-
-    Token token = { TOKEN_EOL, value, 1, line, position };
-
-    return token;
-}
-
-static inline Token create_comma_token(uint32_t line, uint32_t position) {
-    char value[TOKEN_BUFFER_SIZE] = {
-        [0] = ','
-    };
-
-    Token token = { TOKEN_COMMA, value, 1, line, position };
-
-    return token;
-}
-
 
 // Parser
 typedef enum {
@@ -115,12 +92,14 @@ typedef enum {
     DIRECTIVE_ORG,
     DIRECTIVE_BANK,
     DIRECTIVE_DB,
+    DIRECTIVE_INCLUDE,
+    DIRECTIVE_INCBIN,
     DIRECTIVE_MAX
     //DIRECTIVE_STRING,
     //DIRECTIVE_DEFINE,
 } DirectiveType;
 
-typedef uint8_t(*DirectiveHandle)(const char[TOKEN_BUFFER_SIZE], uint8_t length);
+typedef uint8_t(*DirectiveHandle)(const char* token, uint16_t length);
 
 typedef struct {
     const char* name;
@@ -138,12 +117,20 @@ typedef struct {
 
     uint16_t argumentCount;
     Argument* arguments;
+
+    // Line the action is on, kasm_assemble reports its errors there
+    uint32_t line;
 } Action;
 
-typedef struct {
-    char* name;
-    uint32_t position;
-} Label;
+// A label reference that was encoded before the label was defined, patched once it is
+struct Fixup {
+    struct Fixup* next;
+
+    uint32_t bank;
+    uint32_t address;
+    uint8_t size;
+};
+
 
 
 // Kasm
@@ -152,20 +139,65 @@ typedef enum {
     BUILD_STATE_ALLOC_TOKENS,
     BUILD_STATE_TOKENIZE,
     BUILD_STATE_PARSE_TOKENS,
-    BUILD_STATE_FINALIZE
+    BUILD_STATE_ASSEMBLE,
+    BUILD_STATE_FINALIZE,
+    BUILD_STATE_MAX
 } BuildState;
 
+typedef enum {
+    // Encode every line as soon as it is parsed, forward label references get backpatched
+    BUILD_FLAG_SINGLE_PASS = 0b00000001,
+
+    // Parse and encode each line as it is lexed, implies single pass
+    // Only the current line is held as tokens, memory doesn't grow with the size of the source
+    BUILD_FLAG_STREAM      = 0b00000010,
+
+    // Split big sources at new lines and tokenize the chunks on every core, ignored when streaming
+    BUILD_FLAG_PARALLEL_LEX = 0b00000100,
+
+    // Write every bank that has bytes to a file of its own, bank 1 of "rom.bin" goes to "rom.bank1.bin"
+    BUILD_FLAG_SPLIT_BANKS  = 0b00001000,
+
+    // Write an object instead of the image, labels that never get defined become imports for kasm_link to resolve
+    // With kasm_link itself it makes a partial link, the labels that are still undefined stay imports
+    BUILD_FLAG_OBJECT       = 0b00010000,
+
+    // Fail on .include and .incbin, for sources from somewhere the files around us shouldn't be readable from
+    BUILD_FLAG_NO_FILES     = 0b00100000
+} BuildFlag;
+
 typedef enum {
     BUILD_RESULT_SUCCESS,
     BUILD_RESULT_FILE_ERROR,
     BUILD_RESULT_SYNTAX_ERROR,
     BUILD_RESULT_ALLOC_FAILED,
     BUILD_RESULT_BUFFER_OVERFLOW,
+    BUILD_RESULT_TARGET_ERROR,
+    BUILD_RESULT_ASSEMBLY_ERROR,
+    BUILD_RESULT_LINK_ERROR,
     BUILD_RESULT_UNKOWN_ERROR
 } BuildResult;
 
+// Anything above TARGET_SIGNATURE_CONFLICT means the target can't be used
+typedef enum {
+    TARGET_OK,
+    TARGET_SIGNATURE_CONFLICT,
+    TARGET_ALLOC_FAILED,
+    TARGET_INVALID
+} TargetResult;
+
+// Two opcodes with the same mnemonic and operand types, only the first one can ever be assembled
+typedef struct {
+    uint16_t first;
+    uint16_t second;
+} OpcodeConflict;
+
+typedef struct OpcodeIndex OpcodeIndex;
+typedef struct ParserContext ParserContext;
+typedef struct IncludeCache IncludeCache;
+
 typedef void (*AssembleFn)(const char*);
-typedef OpcodeDef*(*GetOpenCodeFn)(uint16_t);
+typedef const OpcodeDef*(*GetOpenCodeFn)(uint16_t);
 typedef uint16_t(*GetOperandSizeFn)(OperandType);
 
 typedef struct {
@@ -180,31 +212,158 @@ typedef struct {
 
     AssembleFn assemble;
     GetOpenCodeFn get_opcode;
+    GetOperandSizeFn get_operand_size;
+
+    // Lookup tables generated at compile time, see targets/tablegen.c, NULL has them built at registration
+    const OpcodeIndex* tables;
+
+    // Filled in by kasm_register_target, targets leave this NULL
+    const OpcodeIndex* opcodeIndex;
 } BuildTarget;
 
+// Where the time and memory of a build went, filled in when BuildContext.stats points at one
+// Every field covers the last build only
+typedef struct {
+    // Seconds spent in every BuildState, a streamed build switches between tokenizing and parsing on every line
+    double wallTime[BUILD_STATE_MAX];
+
+    // CPU seconds of the building thread, reading that clock costs too much to do per line
+    // so a streamed build counts the time of its lines under BUILD_STATE_TOKENIZE only
+    double cpuTime[BUILD_STATE_MAX];
+
+    double totalWallTime;
+    double totalCpuTime;
+
+    uint64_t sourceSize;
+    uint32_t lines;
+    uint64_t tokens;
+    uint32_t actions;
+    uint32_t labels;
+
+    // Heap memory held by the context for tokens, actions, labels, the arena, the image and the output
+    // Nothing gets given back during a build, so what it holds at the end is its peak
+    uint64_t peakMemory;
+
+    // The part of that this build had to allocate, 0 once a reused context has grown to fit
+    uint64_t allocatedBytes;
+
+    // Bytes written to the image, gaps don't count
+    uint64_t outputSize;
+
+    // Bookkeeping of the running build
+    double stateWall;
+    double stateCpu;
+    uint8_t wallState;
+    uint8_t cpuState;
+    uint64_t startMemory;
+} BuildStats;
+
 typedef struct {
     BuildTarget* target;
     uint8_t buildState;
+    uint8_t flags;
 
     uint8_t assemblerResult;
     uint8_t tokenizerResult;
+    uint8_t parserResult;
+    uint8_t assemblyResult;
+    uint8_t linkerResult;
+
+    // Token that caused a syntax error and the line of any syntax or assembly error
+    // The parser counts lines as it goes, only a lexer error gets its line counted from the tokens
+    uint32_t errorToken;
+    uint32_t errorLine;
+
+    // Input of kasm_link that failed, the input count when the failure came after the last one
+    uint32_t errorObject;
+
+    // Lines that were streamed through and already cleared from the tokens
+    uint32_t lineOffset;
 
-    List tokens;
-    List actions;
+    // The tokens point straight into the source, so it stays open for the whole build
+    SourceFile source;
 
-    List labels;
+    // Where the source was read from, NULL when it came from memory, includes are looked up next to it
+    const char* sourcePath;
+    TokenStream tokens;
+    // Actions are stored inline, their arguments live in the arena
+    Vector actions;
+
+    // SourceFiles mapped by .incbin, the actions refer to them by index and they stay mapped until the build ends
+    Vector binaries;
+
+    // Labels by interned id, label arguments hold the id
+    SymbolTable labels;
+
+    // Every token, action and label of a build lives in here, it gets reset when the build ends
+    Arena arena;
+
+    // Encoded bytes by bank and address, these stay around after the build for the caller to use
+    Image image;
+
+    // Flat copy of the image, only kasm_build_buffer fills it
+    ByteBuffer output;
+    uint32_t position;
+    uint32_t bank;
+
+    // Patched fixups get reused so a long build doesn't keep growing the arena
+    Fixup* freeFixups;
+
+    // Created by the first parse and kept with the context, builds on separate contexts share no state
+    ParserContext* parser;
+
+    // Optional, NULL skips all of the bookkeeping
+    BuildStats* stats;
+
+    // Lexed includes, one cache can be shared by any number of contexts and threads
+    // Without one the context keeps a cache of its own, which also lasts from one build to the next
+    IncludeCache* includes;
 
     uint16_t tokenDepth;
 } BuildContext;
 
 
 // Functions
+// Builds the lookup tables of a target, call this once before sharing the target between builds
+TargetResult kasm_register_target(BuildTarget* target);
+void kasm_unregister_target(BuildTarget* target);
+uint16_t kasm_get_target_conflicts(const BuildTarget* target, const OpcodeConflict** conflicts);
+const char* get_target_result_msg(TargetResult result);
+
+// Assembles the input file into context->image and writes it to output
+// Everything a build touches lives in its context, separate contexts can build on separate threads without locking
+// Banks follow each other in the file a full address space apart, zero padding only goes between written bytes
+// With a NULL output nothing is written and the image gets flattened into context->output instead
+// An object build puts the object in context->output either way
 uint8_t kasm_build(const char* input, const char* output, BuildContext* context);
 
+// Same build straight from memory, no file gets touched and the source only has to stay valid during the call
+// The flattened image ends up in context->output, which grows as needed
+// Wrap caller memory with byte_buffer_wrap to assemble into that instead, an image that doesn't fit fails with BUILD_RESULT_BUFFER_OVERFLOW
+uint8_t kasm_build_buffer(const char* source, uint32_t length, BuildContext* context);
+
+// Combines objects written with BUILD_FLAG_OBJECT into one image and patches their relocations
+// Objects are placed at the banks and addresses they were assembled for, overlapping bytes fail the link
+// The output works like it does for kasm_build, context->flags picks split banks or another object
+uint8_t kasm_link(const char* const* inputs, uint32_t count, const char* output, BuildContext* context);
+const char* get_build_result_msg(BuildResult result);
+const char* get_build_state_name(BuildState state);
+
+// Forgets the last build, every buffer keeps the capacity it grew to so the next build of a similar size allocates nothing
+// kasm_build does this on its own, call it to drop the image and output early
+void kasm_context_reset(BuildContext* context);
+
+// Heap memory the context holds right now, see BuildStats.peakMemory
+uint64_t kasm_context_memory(const BuildContext* context);
+
+// Frees what a context keeps between builds, like the tokens, labels, parser state, output bytes and arena blocks
+void kasm_context_dispose(BuildContext* context);
+
 TokenTypeDef* get_token_type_def(KasmTokenType type);
 
-uint8_t parse_token_type(char* token, uint8_t length, KasmTokenType* tokenType);
+uint8_t parse_token_type(const char* token, uint16_t length, KasmTokenType* tokenType);
 const char* get_token_type_name(KasmTokenType type);
 
-uint8_t parse_directive_type(const char* value, DirectiveType* type);
-uint8_t parse_opcode_type(BuildContext* context, char* value, uint16_t* opcodeId);
\ No newline at end of file
+uint8_t parse_directive_type(const char* value, uint16_t length, DirectiveType* type);
+uint8_t parse_opcode_type(BuildContext* context, const char* value, uint16_t length, uint16_t* opcodeId);
+uint8_t parse_opcode_signature(BuildContext* context, const char* value, uint16_t length, uint32_t signature, uint16_t* opcodeId);
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "object.h"
+#include "assembler.h"
+
+#include <string.h>
+
+// Bytes of a symbol with an empty name, used to reject counts the data can't possibly hold
+#define OBJECT_MIN_SYMBOL_SIZE 7
+#define OBJECT_RELOCATION_SIZE 13
+#define OBJECT_SEGMENT_HEADER_SIZE 12
+
+typedef struct {
+	const uint8_t* data;
+	size_t length;
+	size_t offset;
+} ObjectReader;
+
+static ByteBufferResult put_bytes(ByteBuffer* output, const void* data, uint32_t length) {
+	return byte_buffer_write(output, output->length, data, length);
+}
+
+static ByteBufferResult put_value(ByteBuffer* output, uint32_t value, uint8_t size) {
+	uint8_t bytes[4];
+	for (uint8_t i = 0; i < size; i++)
+		bytes[i] = (uint8_t)(value >> (i * 8));
+
+	return put_bytes(output, bytes, size);
+}
+
+// Returns NULL when the object ends before length more bytes
+static const uint8_t* take(ObjectReader* reader, size_t length) {
+	if (length > reader->length - reader->offset)
+		return NULL;
+
+	const uint8_t* bytes = &reader->data[reader->offset];
+	reader->offset += length;
+	return bytes;
+}
+
+static uint8_t take_value(ObjectReader* reader, uint8_t size, uint32_t* value) {
+	const uint8_t* bytes = take(reader, size);
+	if (bytes == NULL)
+		return 1;
+
+	*value = 0;
+	for (uint8_t i = 0; i < size; i++)
+		*value |= (uint32_t)bytes[i] << (i * 8);
+
+	return 0;
+}
+
+static size_t remaining(const ObjectReader* reader) {
+	return reader->length - reader->offset;
+}
+
+ByteBufferResult object_write(const BuildContext* context, ByteBuffer* output) {
+	const BuildTarget* target = context->target;
+	const Image* image = &context->image;
+	const SymbolTable* labels = &context->labels;
+	uint32_t nameLength = (uint32_t)strlen(target->name);
+
+	byte_buffer_clear(output);
+
+	ByteBufferResult result;
+	if ((result = put_value(output, OBJECT_MAGIC, 4)) != BYTE_BUFFER_OK ||
+		(result = put_value(output, OBJECT_VERSION, 2)) != BYTE_BUFFER_OK ||
+		(result = put_value(output, target->addressSize, 1)) != BYTE_BUFFER_OK ||
+		(result = put_value(output, 0, 1)) != BYTE_BUFFER_OK ||
+		(result = put_value(output, nameLength, 2)) != BYTE_BUFFER_OK ||
+		(result = put_bytes(output, target->name, nameLength)) != BYTE_BUFFER_OK)
+		return result;
+
+	if ((result = put_value(output, image->count, 4)) != BYTE_BUFFER_OK)
+		return result;
+
+	for (uint32_t i = 0; i < image->count; i++) {
+		const ImageSegment* segment = &image->segments[i];
+
+		if ((result = put_value(output, segment->bank, 4)) != BYTE_BUFFER_OK ||
+			(result = put_value(output, segment->address, 4)) != BYTE_BUFFER_OK ||
+			(result = put_value(output, segment->bytes.length, 4)) != BYTE_BUFFER_OK ||
+			(result = put_bytes(output, segment->bytes.data, segment->bytes.length)) != BYTE_BUFFER_OK)
+			return result;
+	}
+
+	if ((result = put_value(output, labels->count, 4)) != BYTE_BUFFER_OK)
+		return result;
+
+	for (uint32_t i = 0; i < labels->count; i++) {
+		const Symbol* symbol = symbol_table_get(labels, i);
+
+		if ((result = put_value(output, symbol->length, 2)) != BYTE_BUFFER_OK ||
+			(result = put_bytes(output, symbol->name, symbol->length)) != BYTE_BUFFER_OK ||
+			(result = put_value(output, symbol->defined, 1)) != BYTE_BUFFER_OK ||
+			(result = put_value(output, symbol->defined ? symbol->position : 0, 4)) != BYTE_BUFFER_OK)
+			return result;
+	}
+
+	// The count goes in front of the relocations, it is only known once the fixups have been walked
+	uint32_t countOffset = output->length;
+	uint32_t relocationCount = 0;
+
+	if ((result = put_value(output, 0, 4)) != BYTE_BUFFER_OK)
+		return result;
+
+	for (uint32_t i = 0; i < labels->count; i++) {
+		const Symbol* symbol = symbol_table_get(labels, i);
+
+		// Defined labels patched their fixups already, only the imports have any left
+		for (const Fixup* fixup = symbol->fixups; fixup != NULL; fixup = fixup->next) {
+			if ((result = put_value(output, i, 4)) != BYTE_BUFFER_OK ||
+				(result = put_value(output, fixup->bank, 4)) != BYTE_BUFFER_OK ||
+				(result = put_value(output, fixup->address, 4)) != BYTE_BUFFER_OK ||
+				(result = put_value(output, fixup->size, 1)) != BYTE_BUFFER_OK)
+				return result;
+
+			relocationCount++;
+		}
+	}
+
+	uint8_t count[4] = { (uint8_t)relocationCount, (uint8_t)(relocationCount >> 8), (uint8_t)(relocationCount >> 16), (uint8_t)(relocationCount >> 24) };
+	return byte_buffer_write(output, countOffset, count, 4);
+}
+
+static ObjectResult image_result_to_object_result(ImageResult result) {
+	switch (result) {
+		case IMAGE_OK:            return OBJECT_OK;
+		case IMAGE_OVERLAP:       return OBJECT_OVERLAP;
+		case IMAGE_ALLOC_FAILED:  return OBJECT_ALLOC_FAILED;
+		default:                  return OBJECT_INVALID;
+	}
+}
+
+static ObjectResult assembler_result_to_object_result(AssemblerResult result) {
+	switch (result) {
+		case ASSEMBLER_OK:                  return OBJECT_OK;
+		case ASSEMBLER_VALUE_OUT_OF_RANGE:  return OBJECT_VALUE_OUT_OF_RANGE;
+		case ASSEMBLER_OUTPUT_OVERLAP:      return OBJECT_OVERLAP;
+		case ASSEMBLER_ALLOC_FAILED:        return OBJECT_ALLOC_FAILED;
+		default:                            return OBJECT_INVALID;
+	}
+}
+
+static ObjectResult link_header(BuildContext* context, ObjectReader* reader) {
+	uint32_t magic, version, addressSize, reserved, nameLength;
+
+	if (take_value(reader, 4, &magic) || magic != OBJECT_MAGIC ||
+		take_value(reader, 2, &version) || version != OBJECT_VERSION ||
+		take_value(reader, 1, &addressSize) || take_value(reader, 1, &reserved) ||
+		take_value(reader, 2, &nameLength))
+		return OBJECT_INVALID;
+
+	const uint8_t* name = take(reader, nameLength);
+	if (name == NULL)
+		return OBJECT_INVALID;
+
+	// The bytes were encoded for one target, they mean nothing to another
+	const BuildTarget* target = context->target;
+	if (addressSize != target->addressSize || strlen(target->name) != nameLength || memcmp(target->name, name, nameLength) != 0)
+		return OBJECT_TARGET_MISMATCH;
+
+	return OBJECT_OK;
+}
+
+static ObjectResult link_segments(BuildContext* context, ObjectReader* reader) {
+	uint32_t count;
+	if (take_value(reader, 4, &count) || count > remaining(reader) / OBJECT_SEGMENT_HEADER_SIZE)
+		return OBJECT_INVALID;
+
+	uint8_t addressSize = context->target->addressSize;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t bank, address, length;
+		if (take_value(reader, 4, &bank) || take_value(reader, 4, &address) || take_value(reader, 4, &length))
+			return OBJECT_INVALID;
+
+		const uint8_t* bytes = take(reader, length);
+		if (bytes == NULL)
+			return OBJECT_INVALID;
+
+		// Same limit the assembler puts on the position
+		if (addressSize < 4 && (uint64_t)address + length > ((uint64_t)1 << (addressSize * 8)))
+			return OBJECT_INVALID;
+
+		ObjectResult result = image_result_to_object_result(image_write(&context->image, bank, address, bytes, length));
+		if (result != OBJECT_OK)
+			return result;
+	}
+
+	return OBJECT_OK;
+}
+
+// ids maps the symbol indices of the object onto ids in context->labels
+static ObjectResult link_symbols(BuildContext* context, ObjectReader* reader, uint32_t** ids, uint32_t* count) {
+	if (take_value(reader, 4, count) || *count > remaining(reader) / OBJECT_MIN_SYMBOL_SIZE)
+		return OBJECT_INVALID;
+
+	*ids = arena_alloc(&context->arena, sizeof(uint32_t) * (*count ? *count : 1));
+	if (*ids == NULL)
+		return OBJECT_ALLOC_FAILED;
+
+	for (uint32_t i = 0; i < *count; i++) {
+		uint32_t length, defined, position;
+		if (take_value(reader, 2, &length) || length == 0)
+			return OBJECT_INVALID;
+
+		const char* name = (const char*)take(reader, length);
+		if (name == NULL || take_value(reader, 1, &defined) || take_value(reader, 4, &position))
+			return OBJECT_INVALID;
+
+		if (!defined) {
+			if (symbol_table_intern(&context->labels, name, (uint16_t)length, &(*ids)[i]) != SYMBOL_OK)
+				return OBJECT_ALLOC_FAILED;
+
+			continue;
+		}
+
+		switch (symbol_table_define(&context->labels, name, (uint16_t)length, position, &(*ids)[i])) {
+			case SYMBOL_OK:         break;
+			case SYMBOL_DUPLICATE:  return OBJECT_DUPLICATE_LABEL;
+			default:                return OBJECT_ALLOC_FAILED;
+		}
+
+		// Objects linked before this one may have been waiting on it
+		ObjectResult result = assembler_result_to_object_result(assemble_define_label(context, (*ids)[i]));
+		if (result != OBJECT_OK)
+			return result;
+	}
+
+	return OBJECT_OK;
+}
+
+static ObjectResult link_relocations(BuildContext* context, ObjectReader* reader, const uint32_t* ids, uint32_t symbolCount) {
+	uint32_t count;
+	if (take_value(reader, 4, &count) || count > remaining(reader) / OBJECT_RELOCATION_SIZE)
+		return OBJECT_INVALID;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t symbol, bank, address, size;
+		if (take_value(reader, 4, &symbol) || take_value(reader, 4, &bank) || take_value(reader, 4, &address) || take_value(reader, 1, &size))
+			return OBJECT_INVALID;
+
+		if (symbol >= symbolCount || size == 0 || size > 4)
+			return OBJECT_INVALID;
+
+		ObjectResult result = assembler_result_to_object_result(assemble_reference(context, ids[symbol], bank, address, (uint8_t)size));
+		if (result != OBJECT_OK)
+			return result;
+	}
+
+	return OBJECT_OK;
+}
+
+ObjectResult object_link(BuildContext* context, const uint8_t* data, size_t length) {
+	ObjectReader reader = { data, length, 0 };
+
+	uint32_t* ids;
+	uint32_t symbolCount;
+
+	ObjectResult result;
+	if ((result = link_header(context, &reader)) != OBJECT_OK ||
+		(result = link_segments(context, &reader)) != OBJECT_OK ||
+		(result = link_symbols(context, &reader, &ids, &symbolCount)) != OBJECT_OK ||
+		(result = link_relocations(context, &reader, ids, symbolCount)) != OBJECT_OK)
+		return result;
+
+	return remaining(&reader) == 0 ? OBJECT_OK : OBJECT_INVALID;
+}
+
+ObjectResult object_check_defined(const BuildContext* context) {
+	for (uint32_t i = 0; i < context->labels.count; i++) {
+		if (!symbol_table_get(&context->labels, i)->defined)
+			return OBJECT_UNDEFINED_LABEL;
+	}
+
+	return OBJECT_OK;
+}
+
+const char* get_object_result_msg(ObjectResult result) {
+	switch (result) {
+		case OBJECT_OK:                  return "OK";
+		case OBJECT_ALLOC_FAILED:        return "Allocation Failed";
+		case OBJECT_INVALID:             return "Invalid Object";
+		case OBJECT_TARGET_MISMATCH:     return "Built For Another Target";
+		case OBJECT_DUPLICATE_LABEL:     return "Duplicate Label";
+		case OBJECT_UNDEFINED_LABEL:     return "Undefined Label";
+		case OBJECT_VALUE_OUT_OF_RANGE:  return "Value Out Of Range";
+		case OBJECT_OVERLAP:             return "Output Overlap";
+		default:                         return "Unknown Error";
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "libkasm.h"
+
+#define OBJECT_MAGIC 0x4A424F4B
+#define OBJECT_VERSION 1
+
+typedef enum {
+	OBJECT_OK,
+	OBJECT_ALLOC_FAILED,
+	OBJECT_INVALID,
+	OBJECT_TARGET_MISMATCH,
+	OBJECT_DUPLICATE_LABEL,
+	OBJECT_UNDEFINED_LABEL,
+	OBJECT_VALUE_OUT_OF_RANGE,
+	OBJECT_OVERLAP
+} ObjectResult;
+
+// An assembled image that still has references to labels it doesn't define, all values are little endian
+//
+//   u32 magic, u16 version, u8 address size, u8 reserved, u16 target name length, target name
+//   u32 segment count,    per segment:    u32 bank, u32 address, u32 length, bytes
+//   u32 symbol count,     per symbol:     u16 name length, name, u8 defined, u32 position
+//   u32 relocation count, per relocation: u32 symbol, u32 bank, u32 address, u8 size
+//
+// Segments keep the bank and address the source put them at, linking places them as they are
+// Every label is in the symbols, the defined ones are exported and the rest are imports
+// A relocation is an import reference that was encoded as zeroes, symbol is its index in the symbols
+
+// Serializes the image and labels of the build that just ran, references to undefined labels become relocations
+// Fails like byte_buffer_write does, BYTE_BUFFER_FULL only comes from a wrapped output
+ByteBufferResult object_write(const BuildContext* context, ByteBuffer* output);
+
+// Adds the object to context->image and context->labels
+// Relocations to labels that are already known get patched, the rest wait for a later object to define them
+ObjectResult object_link(BuildContext* context, const uint8_t* data, size_t length);
+
+// Fails when a label is still only referenced, after the last object was linked
+ObjectResult object_check_defined(const BuildContext* context);
+
+const char* get_object_result_msg(ObjectResult result);
@@ -0,0 +1,151 @@
+#include "opcode.h"
+
+#include <string.h>
+
+// FNV-1a, mnemonics are short so this is plenty
+uint32_t opcode_hash(const char* value, uint16_t length) {
+    uint32_t hash = 2166136261u;
+
+    for (uint16_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)value[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static const OpcodeIndexEntry* opcode_table_slot(const OpcodeTable* table, const char* value, uint16_t length, uint32_t signature) {
+    uint32_t slot = (opcode_hash(value, length) ^ (signature * 0x9E3779B1u)) & table->mask;
+
+    // Linear probing, the table is at most half full so we always hit an empty slot
+    while (table->entries[slot].mnemonic != NULL) {
+        const OpcodeIndexEntry* entry = &table->entries[slot];
+        if (entry->signature == signature && entry->length == length && memcmp(entry->mnemonic, value, length) == 0)
+            return entry;
+
+        slot = (slot + 1) & table->mask;
+    }
+
+    return &table->entries[slot];
+}
+
+static TargetResult opcode_table_init(OpcodeTable* table, uint16_t opcodeCount) {
+    uint32_t slots = 16;
+    while (slots < (uint32_t)opcodeCount * 2)
+        slots *= 2;
+
+    table->entries = calloc(slots, sizeof(OpcodeIndexEntry));
+    if (table->entries == NULL)
+        return TARGET_ALLOC_FAILED;
+
+    table->mask = slots - 1;
+    return TARGET_OK;
+}
+
+static TargetResult add_conflict(OpcodeIndex* index, uint16_t first, uint16_t second) {
+    OpcodeConflict* conflicts = realloc((OpcodeConflict*)index->conflicts, sizeof(OpcodeConflict) * (index->conflictCount + 1));
+    if (conflicts == NULL)
+        return TARGET_ALLOC_FAILED;
+
+    conflicts[index->conflictCount].first = first;
+    conflicts[index->conflictCount].second = second;
+
+    index->conflicts = conflicts;
+    index->conflictCount++;
+
+    return TARGET_OK;
+}
+
+TargetResult opcode_index_build(const BuildTarget* target, OpcodeIndex* index) {
+    if (target->get_operand_size == NULL)
+        return TARGET_INVALID;
+
+    // Operand sizes only depend on the OperandType, so ask for them once
+    for (uint8_t i = 0; i < 4; i++) {
+        uint16_t size = target->get_operand_size((OperandType)i);
+        if (size > 4)
+            return TARGET_INVALID;
+
+        index->operandSizes[i] = (uint8_t)size;
+    }
+
+    index->version = OPCODE_INDEX_VERSION;
+    index->opcodeSize = target->opcodeCount > 256 ? 2 : 1;
+
+    uint8_t* lengths = calloc(target->opcodeCount, sizeof(uint8_t));
+    index->lengths = lengths;
+
+    uint32_t* operands = calloc(target->opcodeCount, sizeof(uint32_t));
+    index->operands = operands;
+
+    if (lengths == NULL || operands == NULL)
+        return TARGET_ALLOC_FAILED;
+
+    if (opcode_table_init(&index->mnemonics, target->opcodeCount) != TARGET_OK)
+        return TARGET_ALLOC_FAILED;
+
+    if (opcode_table_init(&index->signatures, target->opcodeCount) != TARGET_OK)
+        return TARGET_ALLOC_FAILED;
+
+    // The entries are const so generated tables can be too, these were just allocated and are ours to fill
+    for (uint16_t i = 0; i < target->opcodeCount; i++) {
+        const OpcodeDef* opcode = target->get_opcode(i);
+        if (opcode == NULL || opcode->mnemonic == NULL)
+            continue;
+
+        size_t length = strlen(opcode->mnemonic);
+        if (length == 0 || length > TOKEN_MAX_LENGTH)
+            continue;
+
+        if (opcode->operandCount > OPCODE_SIGNATURE_MAX_OPERANDS || (opcode->operandCount > 0 && opcode->operands == NULL))
+            return TARGET_INVALID;
+
+        // The first definition of a mnemonic wins, just like the old linear scan
+        OpcodeIndexEntry* entry = (OpcodeIndexEntry*)opcode_table_slot(&index->mnemonics, opcode->mnemonic, (uint16_t)length, 0);
+        if (entry->mnemonic == NULL) {
+            *entry = (OpcodeIndexEntry){ opcode->mnemonic, (uint16_t)length, i, 0 };
+        }
+
+        uint32_t size = index->opcodeSize;
+        for (uint8_t j = 0; j < opcode->operandCount; j++) {
+            size += index->operandSizes[opcode->operands[j] & 0x3];
+        }
+
+        lengths[i] = (uint8_t)size;
+
+        uint32_t signature = opcode_signature(opcode->operands, opcode->operandCount);
+        operands[i] = signature;
+
+        entry = (OpcodeIndexEntry*)opcode_table_slot(&index->signatures, opcode->mnemonic, (uint16_t)length, signature);
+        if (entry->mnemonic != NULL) {
+            if (add_conflict(index, entry->opcode, i) != TARGET_OK)
+                return TARGET_ALLOC_FAILED;
+
+            continue;
+        }
+
+        *entry = (OpcodeIndexEntry){ opcode->mnemonic, (uint16_t)length, i, signature };
+    }
+
+    return index->conflictCount ? TARGET_SIGNATURE_CONFLICT : TARGET_OK;
+}
+
+const OpcodeIndexEntry* opcode_index_find(const OpcodeIndex* index, const char* value, uint16_t length) {
+    const OpcodeIndexEntry* entry = opcode_table_slot(&index->mnemonics, value, length, 0);
+    return entry->mnemonic != NULL ? entry : NULL;
+}
+
+const OpcodeIndexEntry* opcode_index_resolve(const OpcodeIndex* index, const char* value, uint16_t length, uint32_t signature) {
+    const OpcodeIndexEntry* entry = opcode_table_slot(&index->signatures, value, length, signature);
+    return entry->mnemonic != NULL ? entry : NULL;
+}
+
+void opcode_index_dispose(OpcodeIndex* index) {
+    free((void*)index->mnemonics.entries);
+    free((void*)index->signatures.entries);
+    free((void*)index->conflicts);
+    free((void*)index->lengths);
+    free((void*)index->operands);
+
+    memset(index, 0, sizeof(OpcodeIndex));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "libkasm.h"
+
+// An operand signature packs the operand count in the low 4 bits and every OperandType in 2 bits above that
+#define OPCODE_SIGNATURE_MAX_OPERANDS 14
+
+static inline uint32_t opcode_signature(const OperandType* operands, uint8_t count) {
+    uint32_t signature = count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        signature |= (uint32_t)(operands[i] & 0x3) << (4 + i * 2);
+    }
+
+    return signature;
+}
+
+static inline OperandType opcode_signature_operand(uint32_t signature, uint8_t index) {
+    return (OperandType)((signature >> (4 + index * 2)) & 0x3);
+}
+
+// Open addressing tables, so lookups don't depend on the ISA size
+// They are built once when the target is registered, or generated at compile time by targets/tablegen.c
+// mnemonics maps a mnemonic to its first opcode, signatures maps a (mnemonic, signature) pair to its exact encoding
+typedef struct {
+    const char* mnemonic;
+    uint16_t length;
+    uint16_t opcode;
+    uint32_t signature;
+} OpcodeIndexEntry;
+
+typedef struct {
+    const OpcodeIndexEntry* entries;
+    uint32_t mask;
+} OpcodeTable;
+
+// Bumped whenever the layout below or opcode_hash changes, generated tables of another version get rebuilt
+#define OPCODE_INDEX_VERSION 1
+
+struct OpcodeIndex {
+    uint32_t version;
+
+    OpcodeTable mnemonics;
+    OpcodeTable signatures;
+
+    // Opcodes that share a mnemonic and signature with an earlier one, they can never be selected
+    const OpcodeConflict* conflicts;
+    uint16_t conflictCount;
+
+    // Encoded size of every opcode, the opcode itself plus its operands
+    const uint8_t* lengths;
+
+    // Operand signature of every opcode, together with lengths this decodes encoded bytes without the OpcodeDefs
+    const uint32_t* operands;
+    uint8_t operandSizes[4];
+    uint8_t opcodeSize;
+};
+
+uint32_t opcode_hash(const char* value, uint16_t length);
+
+TargetResult opcode_index_build(const BuildTarget* target, OpcodeIndex* index);
+const OpcodeIndexEntry* opcode_index_find(const OpcodeIndex* index, const char* value, uint16_t length);
+const OpcodeIndexEntry* opcode_index_resolve(const OpcodeIndex* index, const char* value, uint16_t length, uint32_t signature);
+void opcode_index_dispose(OpcodeIndex* index);
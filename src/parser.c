@@ -1,7 +1,17 @@
 #include "parser.h"
+#include "opcode.h"
+#include "assembler.h"
+#include "include.h"
 
-// The context, I have to free this
-ParserContext* gParserContext;
+#include <string.h>
+
+// Two pass builds reserve an action per this many bytes of source, about one short instruction line
+#define SOURCE_BYTES_PER_ACTION 16
+
+// Deep enough for any sane header tree, it is also what stops a file that includes itself
+#define PARSER_MAX_INCLUDE_DEPTH 32
+
+static ParserResult parse_range(ParserContext* parser, const TokenStream* tokens, uint32_t first, uint32_t end);
 
 // Uses the given rules to validate a token sequence
 static uint8_t validate_token_sequence(TokenTypeDef* base, TokenTypeDef* preceding, TokenTypeDef* succeeding) {
@@ -14,41 +24,119 @@ static uint8_t validate_token_sequence(TokenTypeDef* base, TokenTypeDef* precedi
 	return (pAllowFlag & pFlag) && (sAllowFlag & sFlag);
 }
 
-// Allocates
-static ParserResult define_label(const char* name) {
-    Label* label = malloc(sizeof(Label));
-    if(label == NULL) {
-        return PARSER_ALLOC_FAILED;
+// Parses a decimal or 0x prefixed hexadecimal number, the lexer already validated the digits
+// Fails when the value doesn't fit in 32 bits, leading zeroes are fine
+static uint8_t parse_uint(const char* value, uint16_t length, uint32_t* result) {
+    uint32_t number = 0;
+
+    if (length > 2 && value[0] == '0' && (value[1] | 0x20) == 'x') {
+        for (uint16_t i = 2; i < length; i++) {
+            if (number > 0x0FFFFFFF) {
+                return 1;
+            }
+
+            char chr = value[i] | 0x20;
+            number = (number << 4) | (uint32_t)(chr <= '9' ? chr - '0' : chr - 'a' + 10);
+        }
+
+        *result = number;
+        return 0;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        uint32_t digit = (uint32_t)(value[i] - '0');
+        if (number > (UINT32_MAX - digit) / 10) {
+            return 1;
+        }
+
+        number = number * 10 + digit;
+    }
+
+    *result = number;
+    return 0;
+}
+
+static ParserResult add_argument(ParserContext* parser, uint8_t type, uint32_t value) {
+    if (parser->currentArgumentCount >= parser->currentArgumentCapacity) {
+        if (parser->currentArgumentCapacity == UINT16_MAX) {
+            return PARSER_TOO_MANY_ARGUMENTS;
+        }
+
+        uint32_t capacity = parser->currentArgumentCapacity ? parser->currentArgumentCapacity * 2 : 16;
+        if (capacity > UINT16_MAX) {
+            capacity = UINT16_MAX;
+        }
+
+        Argument* arguments = realloc(parser->currentArguments, sizeof(Argument) * capacity);
+        if (arguments == NULL) {
+            return PARSER_ALLOC_FAILED;
+        }
+
+        parser->currentArguments = arguments;
+        parser->currentArgumentCapacity = (uint16_t)capacity;
+    }
+
+    Argument* argument = &parser->currentArguments[parser->currentArgumentCount++];
+    argument->type = type;
+    argument->value = value;
+
+    return PARSER_OK;
+}
+
+static ParserResult define_label(ParserContext* parser, const char* name, uint16_t length) {
+    // Drop the '@' and ':', references intern the same bare name
+    BuildContext* build = parser->build;
+
+    uint32_t id;
+    if (parser->collect != NULL) {
+        if (symbol_table_intern(&build->labels, &name[1], length - 2, &id) != SYMBOL_OK) {
+            return PARSER_ALLOC_FAILED;
+        }
+
+        parser->collect->label = id + 1;
+        return PARSER_OK;
+    }
+
+    switch (symbol_table_define(&build->labels, &name[1], length - 2, build->position, &id)) {
+        case SYMBOL_OK:         break;
+        case SYMBOL_DUPLICATE:  return PARSER_DUPLICATE_LABEL;
+        default:                return PARSER_ALLOC_FAILED;
     }
 
-    label->name = name;
-    label->position = gParserContext->currentPosition;
+    // Patch whatever referenced it before we got here
+    if ((build->assemblyResult = assemble_define_label(build, id)) != ASSEMBLER_OK) {
+        return PARSER_ASSEMBLY_FAILED;
+    }
 
-    list_add(&gParserContext->build->labels, label);
     return PARSER_OK;
 }
 
-static ParserResult parse_directive(Token* token) {
-    if(gParserContext->currentActionType != ACTION_TYPE_NONE) {
+static ParserResult parse_directive(ParserContext* parser, const char* value, uint16_t length) {
+    if(parser->currentActionType != ACTION_TYPE_NONE) {
         return PARSER_MULTIPLE_ACTIONS_ERROR;
     }
 
-    gParserContext->currentActionType = ACTION_TYPE_DIRECTIVE;
+    parser->currentActionType = ACTION_TYPE_DIRECTIVE;
 
-    if(parse_directive_type(token->value, &gParserContext->currentActionType)) {
+    // Skip the '.'
+    DirectiveType type;
+    if(parse_directive_type(&value[1], length - 1, &type)) {
         return PARSER_INVALID_DIRECTIVE;
     }
 
+    parser->currentValue = type;
     return PARSER_OK;
 }
 
-static ParserResult parse_instruction(Token* token) {
-    if(gParserContext->currentActionType != ACTION_TYPE_NONE) {
+static ParserResult parse_instruction(ParserContext* parser, const char* value, uint16_t length) {
+    if(parser->currentActionType != ACTION_TYPE_NONE) {
         return PARSER_MULTIPLE_ACTIONS_ERROR;
     }
 
-    if(parse_opcode_type(gParserContext->build, token->value, &gParserContext->currentActionType) == 0) {
-        gParserContext->currentActionType = ACTION_TYPE_OPCODE;
+    if(parse_opcode_type(parser->build, value, length, &parser->currentValue) == 0) {
+        parser->currentActionType = ACTION_TYPE_OPCODE;
+        parser->currentMnemonic = value;
+        parser->currentMnemonicLength = length;
         return PARSER_OK;
     }
 
@@ -57,99 +145,532 @@ static ParserResult parse_instruction(Token* token) {
     return PARSER_INVALID_INSTRUCTION;
 }
 
-static ParserResult parse_immediate(Token* token) {
-    // Create the value
-    uint32_t value = (uint32_t)strtoul(token->value[1], NULL, 0);
+static ParserResult parse_immediate(ParserContext* parser, const char* value, uint16_t length) {
+    // Create the value, skipping the '#'
+    uint32_t immediate;
+    if (parse_uint(&value[1], length - 1, &immediate)) {
+        return PARSER_IMMEDIATE_OUT_OF_RANGE;
+    }
 
     // We calculate the size of this immediate
     uint8_t size;
 
-    if (value <= 0xFF)          size = 1;
-    else if (value <= 0xFFFF)   size = 2;
-    else                        size = 4;
+    if (immediate <= 0xFF)          size = 1;
+    else if (immediate <= 0xFFFF)   size = 2;
+    else                            size = 4;
 
     // If we are out of the range of the given target throw an error
-    if(gParserContext->build->target->immediateSize != size) {
+    if(size > parser->build->target->immediateSize) {
         return PARSER_IMMEDIATE_OUT_OF_RANGE;
     }
 
-    // Allocate the argument
-    Argument* argument = malloc(sizeof(Argument));
-    if(argument == NULL) {
-        return LIST_ALLOC_FAILED;
+    return add_argument(parser, ARGUMENT_IMMEDIATE, immediate);
+}
+
+// Registers are r0 to rN, sp and pc are mapped onto the last two registers of the target
+static ParserResult parse_register(ParserContext* parser, const char* value, uint16_t length) {
+    uint8_t registerCount = parser->build->target->registerCount;
+    uint32_t index;
+
+    if (value[0] == 's')        index = registerCount - 2;
+    else if (value[0] == 'p')   index = registerCount - 1;
+    else if (parse_uint(&value[1], length - 1, &index)) return PARSER_INVALID_REGISTER;
+
+    if (index >= registerCount) {
+        return PARSER_INVALID_REGISTER;
     }
 
-    // Create an immediate
-    argument->type = ARGUMENT_IMMEDIATE;
-    argument->value = value;
+    return add_argument(parser, ARGUMENT_REGISTER, index);
+}
 
-    // Add it
-    list_add(&gParserContext->currentArguments, argument);
+static ParserResult parse_address(ParserContext* parser, const char* value, uint16_t length) {
+    // Skip the '$'
+    uint32_t address;
+    if (parse_uint(&value[1], length - 1, &address)) {
+        return PARSER_IMMEDIATE_OUT_OF_RANGE;
+    }
+
+    return add_argument(parser, ARGUMENT_ADDRESS, address);
 }
 
-static ParserResult parse_token(Token* token) {
-	switch(token->type) {
-        case TOKEN_LABEL_DEF:       return define_label(token->value);
-        case TOKEN_DIRECTIVE:       return parse_directive(token);
-        case TOKEN_INSTRUCTION:     return parse_instruction(token);
-        case TOKEN_IMMEDIATE:       return parse_immediate(token);
-        case TOKEN_REGISTER:        return parse_register(token);
-        case TOKEN_ADDRESS:         return parse_address(token);
-        case TOKEN_LABEL_REF:       return parse_label(token);
+// Label references may come before the definition, interning gives us the id either way
+static ParserResult parse_label(ParserContext* parser, const char* value, uint16_t length) {
+    SymbolTable* labels = &parser->build->labels;
+    uint32_t count = labels->count;
+
+    uint32_t id;
+    if (symbol_table_intern(labels, &value[1], length - 1, &id) != SYMBOL_OK) {
+        return PARSER_ALLOC_FAILED;
+    }
+
+    // A new symbol means this is its first reference, that's where it gets reported if it never gets defined
+    if (id == count) {
+        symbol_table_get(labels, id)->reference = parser->line;
     }
+
+    return add_argument(parser, ARGUMENT_LABEL, id);
 }
 
-ParserResult kasm_parse(BuildContext* buildContext) {
-    // Init the relevant lists
-    if(list_init(&buildContext->actions) != LIST_OK) {
+static ParserResult parse_string(ParserContext* parser, const char* value, uint16_t length) {
+    parser->currentString = &value[1];
+    parser->currentStringLength = length - 2;
+    return PARSER_OK;
+}
+
+static IncludeCache* include_cache_of(ParserContext* parser) {
+    if (parser->build->includes != NULL) {
+        return parser->build->includes;
+    }
+
+    if (parser->includes == NULL) {
+        parser->includes = malloc(sizeof(IncludeCache));
+
+        if (parser->includes == NULL) {
+            return NULL;
+        }
+
+        include_cache_init(parser->includes);
+    }
+
+    return parser->includes;
+}
+
+// Parses the cached tokens of the file as if they were written in place of the .include
+static ParserResult include_file(ParserContext* parser) {
+    const char* name = parser->currentString;
+    uint16_t nameLength = parser->currentStringLength;
+    uint16_t argumentCount = parser->currentArgumentCount;
+
+    parser->currentArgumentCount = 0;
+    parser->currentActionType = ACTION_TYPE_NONE;
+    parser->currentValue = 0;
+    parser->currentString = NULL;
+
+    if (name == NULL || nameLength == 0 || argumentCount > 0) {
+        return PARSER_INVALID_OPERANDS;
+    }
+
+    // A line that gets handed back on its own can't stand in for a whole file
+    if (parser->collect != NULL) {
+        return PARSER_INVALID_DIRECTIVE;
+    }
+
+    if (parser->includeDepth >= PARSER_MAX_INCLUDE_DEPTH) {
+        return PARSER_INCLUDE_TOO_DEEP;
+    }
+
+    IncludeCache* cache = include_cache_of(parser);
+    if (cache == NULL) {
         return PARSER_ALLOC_FAILED;
     }
-    
-    if(list_init(&buildContext->labels)) {
+
+    char path[INCLUDE_MAX_PATH];
+    IncludeFile* file;
+    IncludeResult includeResult;
+
+    if ((includeResult = include_resolve_path(parser->path, name, nameLength, path, sizeof(path))) != INCLUDE_OK ||
+        (includeResult = include_cache_acquire(cache, path, &file)) != INCLUDE_OK) {
+        return includeResult == INCLUDE_ALLOC_FAILED ? PARSER_ALLOC_FAILED : PARSER_INCLUDE_FAILED;
+    }
+
+    const TokenStream* tokens = parser->tokens;
+    const char* including = parser->path;
+
+    parser->path = file->path;
+    parser->includeDepth++;
+
+    // An error in there is reported on the .include line, the outer parse_range sets the token after us
+    ParserResult result = parse_range(parser, &file->tokens, 0, file->tokens.count);
+
+    parser->tokens = tokens;
+    parser->path = including;
+    parser->includeDepth--;
+
+    include_cache_release(cache, file);
+    return result;
+}
+
+// Maps the file of an .incbin, its arguments become the index of the mapping, the offset and the length
+// The bytes get copied straight from the mapping when the action is encoded
+static ParserResult map_binary(ParserContext* parser) {
+    BuildContext* build = parser->build;
+    const Argument* arguments = parser->currentArguments;
+    uint16_t argumentCount = parser->currentArgumentCount;
+
+    if (parser->currentString == NULL || parser->currentStringLength == 0 || argumentCount > 2) {
+        return PARSER_INVALID_OPERANDS;
+    }
+
+    // Addresses aren't held to the immediate size, so those work for offsets and lengths past it
+    for (uint16_t i = 0; i < argumentCount; i++) {
+        if (arguments[i].type != ARGUMENT_IMMEDIATE && arguments[i].type != ARGUMENT_ADDRESS) {
+            return PARSER_INVALID_OPERANDS;
+        }
+    }
+
+    // The mapping has to outlive the line, which a line handed back on its own doesn't guarantee
+    if (parser->collect != NULL) {
+        return PARSER_INVALID_DIRECTIVE;
+    }
+
+    char path[INCLUDE_MAX_PATH];
+    if (include_resolve_path(parser->path, parser->currentString, parser->currentStringLength, path, sizeof(path)) != INCLUDE_OK) {
+        return PARSER_INCBIN_FAILED;
+    }
+
+    if (build->binaries.stride == 0) {
+        vector_init(&build->binaries, sizeof(SourceFile));
+    }
+
+    SourceFile file = { 0 };
+    switch (source_open(path, &file)) {
+        case SOURCE_OK:             break;
+        case SOURCE_ALLOC_FAILED:   return PARSER_ALLOC_FAILED;
+        default:                    return PARSER_INCBIN_FAILED;
+    }
+
+    if (vector_push(&build->binaries, &file) != VECTOR_OK) {
+        source_close(&file);
         return PARSER_ALLOC_FAILED;
     }
 
-    // If gParserContext is not null we can assume we can free it
-    if(gParserContext != NULL) {
-        free(gParserContext);
-        gParserContext = NULL;
+    uint64_t offset = argumentCount > 0 ? arguments[0].value : 0;
+    uint64_t length = argumentCount > 1 ? arguments[1].value : (offset < file.length ? file.length - offset : 0);
+
+    if (offset + length > file.length) {
+        return PARSER_INCBIN_OUT_OF_RANGE;
+    }
+
+    parser->currentArgumentCount = 0;
+
+    ParserResult result;
+    if ((result = add_argument(parser, ARGUMENT_NONE, build->binaries.count - 1)) != PARSER_OK ||
+        (result = add_argument(parser, ARGUMENT_NONE, (uint32_t)offset)) != PARSER_OK ||
+        (result = add_argument(parser, ARGUMENT_NONE, (uint32_t)length)) != PARSER_OK) {
+        return result;
+    }
+
+    return PARSER_OK;
+}
+
+// Turns the collected state of a line into an action
+static ParserResult end_action(ParserContext* parser) {
+    if (parser->currentActionType == ACTION_TYPE_NONE) {
+        return PARSER_OK;
+    }
+
+    uint8_t readsFile = parser->currentActionType == ACTION_TYPE_DIRECTIVE &&
+        (parser->currentValue == DIRECTIVE_INCLUDE || parser->currentValue == DIRECTIVE_INCBIN);
+
+    if (readsFile && (parser->build->flags & BUILD_FLAG_NO_FILES)) {
+        return PARSER_FILES_NOT_ALLOWED;
+    }
+
+    // Only the directives that read a file take a string, anywhere else it would just get dropped
+    if (parser->currentString != NULL && !readsFile) {
+        return PARSER_INVALID_OPERANDS;
+    }
+
+    if (parser->currentActionType == ACTION_TYPE_DIRECTIVE && parser->currentValue == DIRECTIVE_INCLUDE) {
+        return include_file(parser);
+    }
+
+    if (parser->currentActionType == ACTION_TYPE_DIRECTIVE && parser->currentValue == DIRECTIVE_INCBIN) {
+        ParserResult result;
+        if ((result = map_binary(parser)) != PARSER_OK) {
+            return result;
+        }
+    }
+
+    BuildContext* build = parser->build;
+    Argument* arguments = parser->currentArguments;
+    uint16_t argumentCount = parser->currentArgumentCount;
+
+    // Pick the encoding that matches the operands we got, arguments map onto OperandType through their low bits
+    if (parser->currentActionType == ACTION_TYPE_OPCODE) {
+        if (argumentCount > OPCODE_SIGNATURE_MAX_OPERANDS) {
+            return PARSER_INVALID_OPERANDS;
+        }
+
+        uint32_t signature = argumentCount;
+        for (uint16_t i = 0; i < argumentCount; i++) {
+            signature |= (uint32_t)(arguments[i].type & 0x3) << (4 + i * 2);
+        }
+
+        if (parse_opcode_signature(build, parser->currentMnemonic, parser->currentMnemonicLength, signature, &parser->currentValue)) {
+            return PARSER_INVALID_OPERANDS;
+        }
+    }
+
+    parser->actionCount++;
+
+    Action action = {
+        .type = parser->currentActionType,
+        .value = parser->currentValue,
+        .argumentCount = argumentCount,
+        .arguments = arguments,
+        .line = parser->line
+    };
+
+    parser->currentArgumentCount = 0;
+    parser->currentActionType = ACTION_TYPE_NONE;
+    parser->currentValue = 0;
+    parser->currentString = NULL;
+
+    // The caller does the rest, the arguments stay valid until the next line
+    if (parser->collect != NULL) {
+        parser->collect->action = action;
+        return PARSER_OK;
+    }
+
+    // Single pass, encode it right now and forget about it
+    if (build->flags & (BUILD_FLAG_SINGLE_PASS | BUILD_FLAG_STREAM)) {
+        if ((build->assemblyResult = assemble_action(build, &action)) != ASSEMBLER_OK) {
+            return PARSER_ASSEMBLY_FAILED;
+        }
+
+        return PARSER_OK;
     }
 
-    // Allocate a parser context, check if we succeeded
-    gParserContext = calloc(1, sizeof(ParserContext));
+    // Otherwise keep it for kasm_assemble, we still lay it out so labels get their position
+    if ((build->assemblyResult = assemble_skip_action(build, &action)) != ASSEMBLER_OK) {
+        return PARSER_ASSEMBLY_FAILED;
+    }
+
+    if (argumentCount > 0) {
+        action.arguments = arena_alloc(&build->arena, sizeof(Argument) * argumentCount);
+        if (action.arguments == NULL) {
+            return PARSER_ALLOC_FAILED;
+        }
+
+        memcpy(action.arguments, arguments, sizeof(Argument) * argumentCount);
+    }
 
-    if(gParserContext == NULL) {
+    if (vector_push(&build->actions, &action) != VECTOR_OK) {
         return PARSER_ALLOC_FAILED;
     }
 
-    // Initialize the argument list
-    if(list_init(&gParserContext->currentArguments)) {
+    return PARSER_OK;
+}
+
+static ParserResult parse_token(ParserContext* parser, uint32_t index) {
+    const TokenStream* tokens = parser->tokens;
+
+    const char* value = token_stream_value(tokens, index);
+    uint16_t length = tokens->lengths[index];
+
+	switch(tokens->types[index]) {
+        case TOKEN_LABEL_DEF:       return define_label(parser, value, length);
+        case TOKEN_DIRECTIVE:       return parse_directive(parser, value, length);
+        case TOKEN_INSTRUCTION:     return parse_instruction(parser, value, length);
+        case TOKEN_IMMEDIATE:       return parse_immediate(parser, value, length);
+        case TOKEN_REGISTER:        return parse_register(parser, value, length);
+        case TOKEN_ADDRESS:         return parse_address(parser, value, length);
+        case TOKEN_LABEL_REF:       return parse_label(parser, value, length);
+        case TOKEN_STRING:          return parse_string(parser, value, length);
+        case TOKEN_EOL:             return end_action(parser);
+        default:                    return PARSER_OK;
+    }
+}
+
+// The parser state hangs off the build context, so builds on separate contexts never share it
+static ParserContext* parser_of(BuildContext* buildContext) {
+    if (buildContext->parser == NULL) {
+        buildContext->parser = calloc(1, sizeof(ParserContext));
+
+        if (buildContext->parser == NULL) {
+            return NULL;
+        }
+    }
+
+    ParserContext* parser = buildContext->parser;
+    parser->build = buildContext;
+    parser->collect = NULL;
+    parser->currentActionType = ACTION_TYPE_NONE;
+    parser->currentValue = 0;
+    parser->currentArgumentCount = 0;
+    parser->currentString = NULL;
+    parser->tokens = &buildContext->tokens;
+    parser->path = buildContext->sourcePath;
+    parser->includeDepth = 0;
+
+    return parser;
+}
+
+ParserResult kasm_parse_begin(BuildContext* buildContext) {
+    // A context that built before keeps its storage and only gets emptied
+    if (buildContext->actions.stride == 0) {
+        vector_init(&buildContext->actions, sizeof(Action));
+    }
+
+    vector_clear(&buildContext->actions);
+
+    // Only two pass builds keep their actions, sizing them from the source saves most of the growing
+    if (!(buildContext->flags & (BUILD_FLAG_SINGLE_PASS | BUILD_FLAG_STREAM))) {
+        if (vector_reserve(&buildContext->actions, (uint32_t)(buildContext->source.length / SOURCE_BYTES_PER_ACTION)) != VECTOR_OK) {
+            return PARSER_ALLOC_FAILED;
+        }
+    }
+
+    if (buildContext->labels.symbols == NULL) {
+        if(symbol_table_init(&buildContext->labels) != SYMBOL_OK) {
+            return PARSER_ALLOC_FAILED;
+        }
+    }
+    else {
+        symbol_table_clear(&buildContext->labels);
+    }
+
+    // The parser context is reused too, including its argument buffer
+    ParserContext* parser = parser_of(buildContext);
+    if (parser == NULL) {
         return PARSER_ALLOC_FAILED;
     }
 
-    // Create the current instruction to hold the data
+    parser->actionCount = 0;
+    parser->line = 0;
+
+    buildContext->position = 0;
+    buildContext->bank = 0;
+
+    return PARSER_OK;
+}
 
-	for (int i = 0; i < buildContext->tokens.count; i++) {
-		Token* base = buildContext->tokens.values[i];
+// Validates and parses the tokens [first, end), the stream is treated as if a line ends on both sides
+static ParserResult parse_range(ParserContext* parser, const TokenStream* tokens, uint32_t first, uint32_t end) {
+    BuildContext* buildContext = parser->build;
+    parser->tokens = tokens;
 
-		Token* preceding = NULL;
-		TokenTypeDef* precedingType = get_token_type_def(TOKEN_EOL);
-		if (i > 0) {
-			preceding = buildContext->tokens.values[i - 1];
-			precedingType = preceding->type;
-		}
+    // Walk the packed token types, the neighbours are just the bytes next to it
+    const uint8_t* types = tokens->types;
 
-		Token* succeeding = NULL;
-		TokenTypeDef* succeedingType = get_token_type_def(TOKEN_EOL);
-		if (i < buildContext->tokens.count - 1) {
-			succeeding = buildContext->tokens.values[i + 1];
-			succeedingType = succeeding->type;
-		}
+	for (uint32_t i = first; i < end; i++) {
+		uint8_t precedingType = i > first ? types[i - 1] : TOKEN_EOL;
+		uint8_t succeedingType = i + 1 < end ? types[i + 1] : TOKEN_EOL;
 
-		if (!validate_token_sequence(base->type, precedingType, succeedingType)) {
+		if (!validate_token_sequence(get_token_type_def(types[i]), get_token_type_def(precedingType), get_token_type_def(succeedingType))) {
+            buildContext->errorToken = i;
+            buildContext->errorLine = parser->line;
 			return PARSER_TOKEN_SEQUENCE_ERROR;
         }
 
-		
+        ParserResult result;
+        if ((result = parse_token(parser, i)) != PARSER_OK) {
+            buildContext->errorToken = i;
+            buildContext->errorLine = parser->line;
+            return result;
+        }
+
+        if (types[i] == TOKEN_EOL && parser->includeDepth == 0) {
+            parser->line++;
+        }
 	}
+
+    return PARSER_OK;
+}
+
+ParserResult kasm_parse_tokens(BuildContext* buildContext) {
+    return parse_range(buildContext->parser, &buildContext->tokens, 0, buildContext->tokens.count);
+}
+
+ParserResult kasm_parse_line(BuildContext* buildContext, uint32_t first, uint32_t count, ParsedLine* line) {
+    // Unlike kasm_parse_begin this leaves the labels alone, they carry over between lines
+    ParserContext* parser = parser_of(buildContext);
+    if (parser == NULL) {
+        return PARSER_ALLOC_FAILED;
+    }
+
+    parser->collect = line;
+
+    line->action.type = ACTION_TYPE_NONE;
+    line->action.argumentCount = 0;
+    line->label = 0;
+
+    ParserResult result = parse_range(parser, &buildContext->tokens, first, first + count);
+
+    // A line without an end of line token still has to be closed off
+    if (result == PARSER_OK) {
+        result = end_action(parser);
+    }
+
+    parser->collect = NULL;
+    return result;
+}
+
+ParserResult kasm_parse_end(BuildContext* buildContext) {
+    // Close off the last line if the stream didn't end with one
+    ParserResult result;
+    if ((result = end_action(buildContext->parser)) != PARSER_OK) {
+        buildContext->errorLine = buildContext->parser->line;
+        return result;
+    }
+
+    // Every referenced label has to be defined somewhere, unless the linker gets to resolve it
+    if (buildContext->flags & BUILD_FLAG_OBJECT) {
+        return PARSER_OK;
+    }
+
+    for (uint32_t i = 0; i < buildContext->labels.count; i++) {
+        const Symbol* symbol = symbol_table_get(&buildContext->labels, i);
+
+        if (!symbol->defined) {
+            buildContext->errorLine = symbol->reference;
+            return PARSER_UNDEFINED_LABEL;
+        }
+    }
+
+    return PARSER_OK;
+}
+
+ParserResult kasm_parse(BuildContext* buildContext) {
+    ParserResult result;
+    if ((result = kasm_parse_begin(buildContext)) != PARSER_OK) {
+        return result;
+    }
+
+    if ((result = kasm_parse_tokens(buildContext)) != PARSER_OK) {
+        return result;
+    }
+
+    return kasm_parse_end(buildContext);
+}
+
+void kasm_parse_dispose(BuildContext* buildContext) {
+    ParserContext* parser = buildContext->parser;
+    if (parser == NULL) {
+        return;
+    }
+
+    if (parser->includes != NULL) {
+        include_cache_dispose(parser->includes);
+        free(parser->includes);
+    }
+
+    free(parser->currentArguments);
+    free(parser);
+    buildContext->parser = NULL;
+}
+
+const char* get_parser_result_msg(ParserResult result) {
+    switch (result) {
+    case PARSER_OK:                     return "OK";
+    case PARSER_TOKEN_SEQUENCE_ERROR:   return "Unexpected Token";
+    case PARSER_ALLOC_FAILED:           return "Allocation Failed";
+    case PARSER_MULTIPLE_ACTIONS_ERROR: return "Multiple Actions On One Line";
+    case PARSER_INVALID_DIRECTIVE:      return "Invalid Directive";
+    case PARSER_INVALID_INSTRUCTION:    return "Invalid Instruction";
+    case PARSER_IMMEDIATE_OUT_OF_RANGE: return "Immediate Out Of Range";
+    case PARSER_INVALID_REGISTER:       return "Invalid Register";
+    case PARSER_INVALID_OPERANDS:       return "Invalid Operands";
+    case PARSER_DUPLICATE_LABEL:        return "Duplicate Label";
+    case PARSER_UNDEFINED_LABEL:        return "Undefined Label";
+    case PARSER_TOO_MANY_ARGUMENTS:     return "Too Many Arguments";
+    case PARSER_ASSEMBLY_FAILED:        return "Assembly Failed";
+    case PARSER_INCLUDE_FAILED:         return "Could Not Include File";
+    case PARSER_INCLUDE_TOO_DEEP:       return "Includes Nested Too Deep";
+    case PARSER_INCBIN_FAILED:          return "Could Not Include Binary";
+    case PARSER_INCBIN_OUT_OF_RANGE:    return "Range Past The End Of The Binary";
+    case PARSER_FILES_NOT_ALLOWED:      return "Files Can't Be Included In This Build";
+    default:                            return "???";
+    }
 }
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "libkasm.h"
-#include "list.h"
+#include "vector.h"
 
 typedef enum {
 	PARSER_OK,
@@ -10,21 +10,84 @@ typedef enum {
 	PARSER_MULTIPLE_ACTIONS_ERROR,
     PARSER_INVALID_DIRECTIVE,
     PARSER_INVALID_INSTRUCTION,
-    PARSER_IMMEDIATE_OUT_OF_RANGE
+    PARSER_IMMEDIATE_OUT_OF_RANGE,
+    PARSER_INVALID_REGISTER,
+    PARSER_INVALID_OPERANDS,
+    PARSER_DUPLICATE_LABEL,
+    PARSER_UNDEFINED_LABEL,
+    PARSER_TOO_MANY_ARGUMENTS,
+    PARSER_ASSEMBLY_FAILED,
+    PARSER_INCLUDE_FAILED,
+    PARSER_INCLUDE_TOO_DEEP,
+    PARSER_INCBIN_FAILED,
+    PARSER_INCBIN_OUT_OF_RANGE,
+    PARSER_FILES_NOT_ALLOWED
 } ParserResult;
 
+// What a single line parsed into, for callers that lay out and encode on their own
 typedef struct {
+    // Type is ACTION_TYPE_NONE when the line has none, the arguments belong to the parser until the next parse
+    Action action;
+
+    // Id + 1 of the label the line defines, 0 when it doesn't define one
+    uint32_t label;
+} ParsedLine;
+
+struct ParserContext {
 	BuildContext* build;
 
-    //Action* currentAction;
-	uint32_t currentPosition;
+    // Stream being parsed, an include swaps in the tokens of the included file while it is parsed
+    const TokenStream* tokens;
+
+    // File the tokens came from, includes are looked up next to it
+    const char* path;
+    uint16_t includeDepth;
+
+    // Used when the build context doesn't bring a cache of its own
+    IncludeCache* includes;
+
+    // When set, lines are handed back through here instead of being defined, encoded or stored
+    ParsedLine* collect;
 
     uint8_t currentActionType;
     uint16_t currentValue;
-    List currentArguments;
-} ParserContext;
 
-extern ParserContext* gParserContext;
+    // The encoding of an instruction depends on its operands, so the mnemonic is resolved at the end of the line
+    const char* currentMnemonic;
+    uint16_t currentMnemonicLength;
+
+    // Quotes stripped, it points into the tokens' source so it only lasts until the end of the line
+    // Only .include and .incbin take one
+    const char* currentString;
+    uint16_t currentStringLength;
+
+    // Arguments of the current line, stored inline and reused for every line
+    Argument* currentArguments;
+    uint16_t currentArgumentCount;
+    uint16_t currentArgumentCapacity;
+
+    // Actions parsed since kasm_parse_begin, stored or not
+    uint32_t actionCount;
+
+    // Lines of the top level stream parsed since kasm_parse_begin, an included file counts as its .include line
+    uint32_t line;
+};
 
 // Parses the tokens stored in the build context and populates its instruction list and label table.
+// With BUILD_FLAG_SINGLE_PASS every action is assembled straight away instead of being collected.
 ParserResult kasm_parse(BuildContext* buildContext);
+
+// kasm_parse in steps, for when the tokens come in a line at a time
+// kasm_parse_tokens parses whatever is in the stream right now, lines may not be split between calls
+ParserResult kasm_parse_begin(BuildContext* buildContext);
+ParserResult kasm_parse_tokens(BuildContext* buildContext);
+ParserResult kasm_parse_end(BuildContext* buildContext);
+
+// Parses the tokens [first, first + count) of the build's stream, which hold exactly one line, into line
+// Labels only get interned, nothing is defined, laid out or encoded
+ParserResult kasm_parse_line(BuildContext* buildContext, uint32_t first, uint32_t count, ParsedLine* line);
+
+// Frees the parser context of the build, it otherwise sticks around for the next parse
+void kasm_parse_dispose(BuildContext* buildContext);
+
+const char* get_parser_result_msg(ParserResult result);
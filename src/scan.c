@@ -0,0 +1,160 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static const uint8_t gDelimiterTable[256] = {
+	[';'] = 1, [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, [','] = 1
+};
+
+static uint32_t find_delimiter_scalar(const char* source, uint32_t position, uint32_t length) {
+	while (position < length && !gDelimiterTable[(uint8_t)source[position]])
+		position++;
+
+	return position;
+}
+
+static uint32_t find_newline_scalar(const char* source, uint32_t position, uint32_t length) {
+	while (position < length && source[position] != '\n')
+		position++;
+
+	return position;
+}
+
+#ifdef SCAN_X86
+static inline uint32_t count_trailing_zeros(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+// Every delimiter gets compared against the whole block, the movemask gives one bit per byte
+static inline __m128i classify_sse2(__m128i block) {
+	__m128i mask = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(';')), _mm_cmpeq_epi8(block, _mm_set1_epi8(' '))),
+		_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+
+	return _mm_or_si128(mask,
+		_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8(','))));
+}
+
+static uint32_t find_delimiter_sse2(const char* source, uint32_t position, uint32_t length) {
+	while (length - position >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)&source[position]);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(classify_sse2(block));
+
+		if (mask)
+			return position + count_trailing_zeros(mask);
+
+		position += 16;
+	}
+
+	return find_delimiter_scalar(source, position, length);
+}
+
+static uint32_t find_newline_sse2(const char* source, uint32_t position, uint32_t length) {
+	__m128i newline = _mm_set1_epi8('\n');
+
+	while (length - position >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)&source[position]);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+		if (mask)
+			return position + count_trailing_zeros(mask);
+
+		position += 16;
+	}
+
+	return find_newline_scalar(source, position, length);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SCAN_TARGET_AVX2
+#endif
+
+SCAN_TARGET_AVX2
+static uint32_t find_delimiter_avx2(const char* source, uint32_t position, uint32_t length) {
+	while (length - position >= 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)&source[position]);
+
+		__m256i mask = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(';')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))));
+		mask = _mm256_or_si256(mask,
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(','))));
+
+		uint32_t bits = (uint32_t)_mm256_movemask_epi8(mask);
+		if (bits)
+			return position + count_trailing_zeros(bits);
+
+		position += 32;
+	}
+
+	return find_delimiter_sse2(source, position, length);
+}
+
+SCAN_TARGET_AVX2
+static uint32_t find_newline_avx2(const char* source, uint32_t position, uint32_t length) {
+	__m256i newline = _mm256_set1_epi8('\n');
+
+	while (length - position >= 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)&source[position]);
+		uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+
+		if (bits)
+			return position + count_trailing_zeros(bits);
+
+		position += 32;
+	}
+
+	return find_newline_sse2(source, position, length);
+}
+
+static uint8_t cpu_supports_avx2(void) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, 7, 0);
+	if (!(info[1] & (1 << 5)))
+		return 0;
+
+	// The OS also has to save the ymm registers for us
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)))
+		return 0;
+
+	return (_xgetbv(0) & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+static const Scanner gScanners[] = {
+	[SCANNER_SCALAR] = { SCANNER_SCALAR, find_delimiter_scalar, find_newline_scalar },
+#ifdef SCAN_X86
+	[SCANNER_SSE2]   = { SCANNER_SSE2,   find_delimiter_sse2,   find_newline_sse2 },
+	[SCANNER_AVX2]   = { SCANNER_AVX2,   find_delimiter_avx2,   find_newline_avx2 },
+#endif
+};
+
+const Scanner* scan_get_scanner(void) {
+#ifdef SCAN_X86
+	if (cpu_supports_avx2())
+		return &gScanners[SCANNER_AVX2];
+
+	return &gScanners[SCANNER_SSE2];
+#else
+	return &gScanners[SCANNER_SCALAR];
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Both return the index of the first match at or after position, or length when there is none
+// position may be at most length, the block loops count the bytes left so they hold up right below 4 GiB
+typedef uint32_t(*ScanFn)(const char* source, uint32_t position, uint32_t length);
+
+typedef enum {
+	SCANNER_SCALAR,
+	SCANNER_SSE2,
+	SCANNER_AVX2
+} ScannerType;
+
+typedef struct {
+	ScannerType type;
+
+	// Finds the next ';', ' ', '\t', '\r', '\n' or ','
+	ScanFn find_delimiter;
+
+	// Finds the next '\n', used to jump over comment bodies
+	ScanFn find_newline;
+} Scanner;
+
+// Picks the widest scanner the cpu we are running on supports
+const Scanner* scan_get_scanner(void);
@@ -0,0 +1,752 @@
+#include "session.h"
+#include "lexer.h"
+#include "parser.h"
+#include "assembler.h"
+
+#include <string.h>
+
+#define SESSION_INITIAL_LINES 256
+
+static uint8_t fail(KasmSession* session, BuildResult result, uint32_t line) {
+    session->build.assemblerResult = result;
+    session->build.errorLine = line;
+    return 1;
+}
+
+static uint8_t ensure_lines(KasmSession* session, uint32_t count) {
+    if (count <= session->lineCapacity) {
+        return 0;
+    }
+
+    uint32_t capacity = session->lineCapacity ? session->lineCapacity : SESSION_INITIAL_LINES;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    SessionLine* lines = realloc(session->lines, sizeof(SessionLine) * capacity);
+    if (lines == NULL) {
+        return 1;
+    }
+
+    session->lines = lines;
+    session->lineCapacity = capacity;
+    return 0;
+}
+
+static uint8_t ensure_symbols(KasmSession* session) {
+    uint32_t count = session->build.labels.count;
+    if (count <= session->symbolCapacity) {
+        return 0;
+    }
+
+    uint32_t capacity = session->symbolCapacity ? session->symbolCapacity : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    SessionSymbol* symbols = realloc(session->symbols, sizeof(SessionSymbol) * capacity);
+    if (symbols == NULL) {
+        return 1;
+    }
+
+    memset(&symbols[session->symbolCapacity], 0, sizeof(SessionSymbol) * (capacity - session->symbolCapacity));
+    session->symbols = symbols;
+    session->symbolCapacity = capacity;
+    return 0;
+}
+
+static void free_line(SessionLine* line) {
+    free(line->action.arguments);
+    line->action.arguments = NULL;
+}
+
+// Adds or removes what a line defines and references from the label counts
+static void count_line(KasmSession* session, const SessionLine* line, int32_t delta) {
+    if (line->label) {
+        session->symbols[line->label - 1].definitions += delta;
+    }
+
+    for (uint16_t i = 0; i < line->action.argumentCount; i++) {
+        if (line->action.arguments[i].type == ARGUMENT_LABEL) {
+            session->symbols[line->action.arguments[i].value].references += delta;
+        }
+    }
+}
+
+// Returns the parser result for a label id that is defined twice, or used but never defined
+static ParserResult check_symbol(KasmSession* session, uint32_t id) {
+    SessionSymbol* counts = &session->symbols[id];
+    symbol_table_get(&session->build.labels, id)->defined = counts->definitions > 0;
+
+    if (counts->definitions > 1) {
+        return PARSER_DUPLICATE_LABEL;
+    }
+
+    if (counts->references > 0 && counts->definitions == 0) {
+        return PARSER_UNDEFINED_LABEL;
+    }
+
+    return PARSER_OK;
+}
+
+static ParserResult check_line(KasmSession* session, const SessionLine* line, uint32_t* symbol) {
+    ParserResult result;
+
+    if (line->label && (result = check_symbol(session, line->label - 1)) != PARSER_OK) {
+        *symbol = line->label - 1;
+        return result;
+    }
+
+    for (uint16_t i = 0; i < line->action.argumentCount; i++) {
+        const Argument* argument = &line->action.arguments[i];
+        if (argument->type == ARGUMENT_LABEL && (result = check_symbol(session, argument->value)) != PARSER_OK) {
+            *symbol = argument->value;
+            return result;
+        }
+    }
+
+    return PARSER_OK;
+}
+
+// Finds the line to blame for a label problem, the second definition or the first reference
+static uint32_t find_symbol_line(const KasmSession* session, uint32_t id, ParserResult problem) {
+    uint8_t seenDefinition = 0;
+
+    for (uint32_t i = 0; i < session->lineCount; i++) {
+        const SessionLine* line = &session->lines[i];
+
+        if (problem == PARSER_DUPLICATE_LABEL && line->label == id + 1) {
+            if (seenDefinition) {
+                return i;
+            }
+
+            seenDefinition = 1;
+        }
+
+        if (problem == PARSER_UNDEFINED_LABEL) {
+            for (uint16_t j = 0; j < line->action.argumentCount; j++) {
+                if (line->action.arguments[j].type == ARGUMENT_LABEL && line->action.arguments[j].value == id) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return session->lineCount;
+}
+
+static uint8_t references_moved_label(const KasmSession* session, const SessionLine* line) {
+    for (uint16_t i = 0; i < line->action.argumentCount; i++) {
+        const Argument* argument = &line->action.arguments[i];
+        if (argument->type == ARGUMENT_LABEL && session->symbols[argument->value].movedEpoch == session->epoch) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Lexes and parses the lines of source[start, end) into lines, which has room for every one of them
+static uint8_t parse_region(KasmSession* session, const char* source, uint32_t start, uint32_t end, SessionLine* lines, uint32_t firstLine, uint32_t* lineCount) {
+    BuildContext* build = &session->build;
+    TokenStream* tokens = &build->tokens;
+
+    token_stream_clear(tokens);
+
+    // Offsets come out relative to start, we only need them to split the tokens up by line
+    if ((build->tokenizerResult = lex(&source[start], end - start, tokens)) != LEXER_OK) {
+        build->errorToken = tokens->count ? tokens->count - 1 : 0;
+        return fail(session, build->tokenizerResult == LEXER_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_SYNTAX_ERROR,
+            firstLine + token_stream_line(tokens, build->errorToken, TOKEN_EOL));
+    }
+
+    uint32_t count = 0;
+    uint32_t token = 0;
+    uint32_t offset = start;
+
+    while (offset < end) {
+        const char* newline = memchr(&source[offset], '\n', end - offset);
+        uint32_t lineEnd = newline != NULL ? (uint32_t)(newline - source) + 1 : end;
+
+        // Every token before the end of the line is ours, the last line also takes the closing end of line token
+        uint32_t first = token;
+        while (token < tokens->count && (tokens->offsets[token] + start < lineEnd || lineEnd == end)) {
+            token++;
+        }
+
+        ParsedLine parsed;
+        if ((build->parserResult = kasm_parse_line(build, first, token - first, &parsed)) != PARSER_OK) {
+            for (uint32_t i = 0; i < count; i++) {
+                free_line(&lines[i]);
+            }
+
+            return fail(session, build->parserResult == PARSER_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_SYNTAX_ERROR, firstLine + count);
+        }
+
+        SessionLine* line = &lines[count++];
+        memset(line, 0, sizeof(SessionLine));
+
+        line->offset = offset;
+        line->length = lineEnd - offset;
+        line->action = parsed.action;
+        line->action.arguments = NULL;
+        line->label = parsed.label;
+
+        if (parsed.action.argumentCount > 0) {
+            line->action.arguments = malloc(sizeof(Argument) * parsed.action.argumentCount);
+            if (line->action.arguments == NULL) {
+                for (uint32_t i = 0; i < count; i++) {
+                    free_line(&lines[i]);
+                }
+
+                return fail(session, BUILD_RESULT_ALLOC_FAILED, firstLine + count - 1);
+            }
+
+            memcpy(line->action.arguments, parsed.action.arguments, sizeof(Argument) * parsed.action.argumentCount);
+
+            for (uint16_t i = 0; i < parsed.action.argumentCount; i++) {
+                line->hasLabelReference |= parsed.action.arguments[i].type == ARGUMENT_LABEL;
+            }
+        }
+
+        offset = lineEnd;
+    }
+
+    *lineCount = count;
+    return 0;
+}
+
+// Compared a block at a time, memcmp is a lot quicker at this than we are
+#define SESSION_COMPARE_BLOCK 64
+
+static uint32_t common_prefix(const char* a, const char* b, uint32_t length) {
+    uint32_t i = 0;
+    while (i + SESSION_COMPARE_BLOCK <= length && memcmp(&a[i], &b[i], SESSION_COMPARE_BLOCK) == 0) {
+        i += SESSION_COMPARE_BLOCK;
+    }
+
+    while (i < length && a[i] == b[i]) {
+        i++;
+    }
+
+    return i;
+}
+
+// a and b point one past the end of what gets compared
+static uint32_t common_suffix(const char* a, const char* b, uint32_t length) {
+    uint32_t i = 0;
+    while (i + SESSION_COMPARE_BLOCK <= length && memcmp(a - i - SESSION_COMPARE_BLOCK, b - i - SESSION_COMPARE_BLOCK, SESSION_COMPARE_BLOCK) == 0) {
+        i += SESSION_COMPARE_BLOCK;
+    }
+
+    while (i < length && a[-(int64_t)i - 1] == b[-(int64_t)i - 1]) {
+        i++;
+    }
+
+    return i;
+}
+
+// Number of lines that end with a new line at or before offset, the lines are sorted so we can bisect
+static uint32_t lines_ending_before(const KasmSession* session, uint32_t offset) {
+    uint32_t low = 0;
+    uint32_t high = session->lineCount;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const SessionLine* line = &session->lines[middle];
+
+        if (line->offset + line->length <= offset) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    // Only the very last line can be missing its new line, appending to it changes it
+    if (low > 0) {
+        const SessionLine* line = &session->lines[low - 1];
+        if (session->source[line->offset + line->length - 1] != '\n') {
+            low--;
+        }
+    }
+
+    return low;
+}
+
+// Index of the first line at or after first that starts past offset
+static uint32_t first_line_after(const KasmSession* session, uint32_t first, uint32_t offset) {
+    uint32_t low = first;
+    uint32_t high = session->lineCount;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (session->lines[middle].offset > offset) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+
+    return low;
+}
+
+static uint32_t count_lines(const char* source, uint32_t start, uint32_t end) {
+    uint32_t count = 0;
+
+    while (start < end) {
+        const char* newline = memchr(&source[start], '\n', end - start);
+        if (newline == NULL) {
+            return count + 1;
+        }
+
+        count++;
+        start = (uint32_t)(newline - source) + 1;
+    }
+
+    return count;
+}
+
+static void move_label(KasmSession* session, SessionLine* line, uint32_t position) {
+    if (line->label == 0) {
+        return;
+    }
+
+    Symbol* symbol = symbol_table_get(&session->build.labels, line->label - 1);
+    if (symbol->position != position) {
+        symbol->position = position;
+        session->symbols[line->label - 1].movedEpoch = session->epoch;
+    }
+}
+
+static SessionRun* begin_run(KasmSession* session) {
+    if (session->runCount == session->runCapacity) {
+        uint32_t capacity = session->runCapacity ? session->runCapacity * 2 : 16;
+        SessionRun* runs = realloc(session->runs, sizeof(SessionRun) * capacity);
+        if (runs == NULL) {
+            return NULL;
+        }
+
+        session->runs = runs;
+        session->runCapacity = capacity;
+    }
+
+    return &session->runs[session->runCount++];
+}
+
+// Every run moves by the same distance, only a .org changes it and the layout stops right after one
+// Moving right goes from the last run back and moving left from the first on, so no run lands on bytes that are still waiting to move
+static AssemblerResult move_runs(KasmSession* session) {
+    uint32_t count = session->runCount;
+    uint8_t right = count > 0 && session->runs[0].target > session->runs[0].start;
+
+    for (uint32_t i = 0; i < count; i++) {
+        SessionRun* run = &session->runs[right ? count - 1 - i : i];
+
+        switch (image_move(&session->build.image, run->bank, run->start, run->end - run->start, run->target)) {
+        case IMAGE_OK:              break;
+        case IMAGE_ALLOC_FAILED:    return ASSEMBLER_ALLOC_FAILED;
+        case IMAGE_OVERLAP:         return ASSEMBLER_OUTPUT_OVERLAP;
+        case IMAGE_TOO_LARGE:       return ASSEMBLER_ADDRESS_OUT_OF_RANGE;
+        case IMAGE_UNWRITTEN:       return ASSEMBLER_IMAGE_ERROR;
+        case IMAGE_FILE_ERROR:      return ASSEMBLER_IMAGE_ERROR;
+        }
+    }
+
+    return ASSEMBLER_OK;
+}
+
+// Lays out the lines from first on, a partial layout stops as soon as the old lines fall back into place
+// Returns 2 when a .org moves back, overlapping output can't be patched up line by line
+static uint8_t layout(KasmSession* session, uint32_t first, uint32_t newEnd, uint8_t full, uint32_t* layoutEnd) {
+    BuildContext* build = &session->build;
+    SessionLine* lines = session->lines;
+
+    uint32_t position = 0;
+    build->bank = 0;
+
+    if (first > 0) {
+        // The line before us is untouched, where it left the position is where it leaves it now
+        build->position = lines[first - 1].address;
+        build->bank = lines[first - 1].bank;
+        assemble_skip_action(build, &lines[first - 1].action);
+        position = build->position;
+    }
+
+    uint8_t addressSize = build->target->addressSize;
+    uint64_t limit = addressSize < 4 ? (uint64_t)1 << (addressSize * 8) : UINT64_MAX;
+
+    // Old lines between the edit and the next directive move by the same distance, their bytes move as one block
+    SessionRun* run = NULL;
+    session->runCount = 0;
+
+    uint32_t i = first;
+    for (; i < session->lineCount; i++) {
+        SessionLine* line = &lines[i];
+        uint8_t isNew = i < newEnd;
+
+        // Old lines that start where they did before end up exactly where they did before
+        if (!full && !isNew && line->address == position && line->bank == build->bank) {
+            break;
+        }
+
+        uint8_t isDirective = line->action.type == ACTION_TYPE_DIRECTIVE && line->action.value != DIRECTIVE_DB;
+
+        if (!full && !isNew && !isDirective && line->bank == build->bank) {
+            if ((uint64_t)position + line->size > limit) {
+                build->assemblyResult = ASSEMBLER_ADDRESS_OUT_OF_RANGE;
+                *layoutEnd = i;
+                return 1;
+            }
+
+            if (run == NULL) {
+                if ((run = begin_run(session)) == NULL) {
+                    build->assemblyResult = ASSEMBLER_ALLOC_FAILED;
+                    *layoutEnd = i;
+                    return 1;
+                }
+
+                run->bank = build->bank;
+                run->start = line->address;
+                run->end = line->address;
+                run->target = position;
+            }
+
+            if (line->size > 0) {
+                run->end = line->address + line->size;
+            }
+
+            move_label(session, line, position);
+            line->address = position;
+            line->dirty = 0;
+            position += line->size;
+            continue;
+        }
+
+        uint32_t bank = build->bank;
+
+        build->position = position;
+        if ((build->assemblyResult = assemble_skip_action(build, &line->action)) != ASSEMBLER_OK) {
+            *layoutEnd = i;
+            return 1;
+        }
+
+        uint8_t backward = isDirective && line->action.value == DIRECTIVE_ORG && build->position < position;
+
+        session->backwardOrgs += backward;
+        session->backwardOrgs -= line->backward;
+        line->backward = backward;
+
+        if (backward && !full) {
+            *layoutEnd = i;
+            return 2;
+        }
+
+        run = NULL;
+
+        uint32_t size = isDirective ? 0 : build->position - position;
+        uint8_t moved = line->address != position || line->bank != bank;
+
+        // An old line that moved leaves its old bytes behind
+        if (!full && !isNew && moved && image_erase(&build->image, line->bank, line->address, line->size) != IMAGE_OK) {
+            build->assemblyResult = ASSEMBLER_ALLOC_FAILED;
+            *layoutEnd = i;
+            return 1;
+        }
+
+        line->dirty = full || isNew || moved;
+        line->address = position;
+        line->bank = bank;
+        line->size = size;
+
+        move_label(session, line, position);
+        position = build->position;
+    }
+
+    *layoutEnd = i;
+
+    if ((build->assemblyResult = move_runs(session)) != ASSEMBLER_OK) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint8_t encode_line(KasmSession* session, uint32_t index) {
+    SessionLine* line = &session->lines[index];
+    if (line->size == 0) {
+        return 0;
+    }
+
+    session->build.position = line->address;
+    session->build.bank = line->bank;
+    if ((session->build.assemblyResult = assemble_action(&session->build, &line->action)) != ASSEMBLER_OK) {
+        return fail(session, session->build.assemblyResult == ASSEMBLER_ALLOC_FAILED ? BUILD_RESULT_ALLOC_FAILED : BUILD_RESULT_ASSEMBLY_ERROR, index);
+    }
+
+    return 0;
+}
+
+// Lays out and encodes everything from scratch, used after errors and when the output overlaps itself
+static uint8_t rebuild_all(KasmSession* session) {
+    image_clear(&session->build.image);
+    session->backwardOrgs = 0;
+
+    for (uint32_t i = 0; i < session->lineCount; i++) {
+        session->lines[i].backward = 0;
+    }
+
+    uint32_t layoutEnd;
+    if (layout(session, 0, 0, 1, &layoutEnd)) {
+        return fail(session, BUILD_RESULT_ASSEMBLY_ERROR, layoutEnd);
+    }
+
+    for (uint32_t i = 0; i < session->lineCount; i++) {
+        if (encode_line(session, i)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static uint8_t rebuild_changed(KasmSession* session, uint32_t first, uint32_t newEnd, uint8_t* needsFull) {
+    uint32_t layoutEnd;
+    uint8_t result = layout(session, first, newEnd, 0, &layoutEnd);
+
+    if (result == 2) {
+        *needsFull = 1;
+        return 0;
+    }
+
+    if (result) {
+        return fail(session, BUILD_RESULT_ASSEMBLY_ERROR, layoutEnd);
+    }
+
+    for (uint32_t i = first; i < layoutEnd; i++) {
+        if (session->lines[i].dirty && encode_line(session, i)) {
+            return 1;
+        }
+    }
+
+    // Lines that didn't move still point at labels that might have, their new bytes go over the old ones
+    session->build.image.overwrite = 1;
+
+    for (uint32_t i = 0; i < session->lineCount; i++) {
+        SessionLine* line = &session->lines[i];
+
+        if (i >= first && i < layoutEnd && line->dirty) {
+            continue;
+        }
+
+        if (line->hasLabelReference && references_moved_label(session, line) && encode_line(session, i)) {
+            session->build.image.overwrite = 0;
+            return 1;
+        }
+    }
+
+    session->build.image.overwrite = 0;
+    return 0;
+}
+
+uint8_t kasm_session_init(KasmSession* session, BuildTarget* target) {
+    memset(session, 0, sizeof(KasmSession));
+    session->build.target = target;
+    session->build.flags = BUILD_FLAG_SINGLE_PASS;
+    session->epoch = 1;
+
+    if (kasm_register_target(target) > TARGET_SIGNATURE_CONFLICT) {
+        session->build.assemblerResult = BUILD_RESULT_TARGET_ERROR;
+        return 1;
+    }
+
+    if (symbol_table_init(&session->build.labels) != SYMBOL_OK || token_stream_init(&session->build.tokens) != TOKEN_STREAM_OK) {
+        kasm_session_dispose(session);
+        session->build.assemblerResult = BUILD_RESULT_ALLOC_FAILED;
+        return 1;
+    }
+
+    return 0;
+}
+
+uint8_t kasm_session_update(KasmSession* session, const char* source, uint32_t length) {
+    BuildContext* build = &session->build;
+
+    build->tokenizerResult = LEXER_OK;
+    build->parserResult = PARSER_OK;
+    build->assemblyResult = ASSEMBLER_OK;
+    build->assemblerResult = BUILD_RESULT_SUCCESS;
+    build->errorLine = 0;
+
+    // Diff against the last source, everything between the common prefix and suffix gets parsed again
+    uint32_t oldLength = session->length;
+    uint32_t common = oldLength < length ? oldLength : length;
+
+    uint32_t prefix = common_prefix(session->source, source, common);
+    if (prefix == oldLength && prefix == length && session->valid) {
+        return 0;
+    }
+
+    uint32_t suffix = common_suffix(&session->source[oldLength], &source[length], common - prefix);
+
+    // Whole lines only, a line is kept when it ends inside the prefix or starts after a new line inside the suffix
+    uint32_t first = lines_ending_before(session, prefix);
+    uint32_t last = first_line_after(session, first, oldLength - suffix);
+
+    int64_t delta = (int64_t)length - oldLength;
+    uint32_t start = first > 0 ? session->lines[first - 1].offset + session->lines[first - 1].length : 0;
+    uint32_t end = last < session->lineCount ? (uint32_t)(session->lines[last].offset + delta) : length;
+
+    // Parse the changed lines on the side, a line that doesn't parse leaves the session as it was
+    SessionLine* added = NULL;
+    uint32_t addedCount = count_lines(source, start, end);
+
+    if (addedCount > 0 && (added = malloc(sizeof(SessionLine) * addedCount)) == NULL) {
+        return fail(session, BUILD_RESULT_ALLOC_FAILED, first);
+    }
+
+    if (addedCount > 0 && parse_region(session, source, start, end, added, first, &addedCount)) {
+        free(added);
+        return 1;
+    }
+
+    uint32_t removedCount = last - first;
+    uint32_t lineCount = session->lineCount - removedCount + addedCount;
+
+    uint8_t allocFailed = ensure_symbols(session) || ensure_lines(session, lineCount);
+
+    if (!allocFailed && length > session->sourceCapacity) {
+        char* grown = realloc(session->source, length);
+
+        if (grown != NULL) {
+            session->source = grown;
+            session->sourceCapacity = length;
+        }
+
+        allocFailed = grown == NULL;
+    }
+
+    // Nothing was swapped yet, so the session is still on the old source
+    if (allocFailed) {
+        for (uint32_t i = 0; i < addedCount; i++) {
+            free_line(&added[i]);
+        }
+
+        free(added);
+        return fail(session, BUILD_RESULT_ALLOC_FAILED, first);
+    }
+
+    // Overlapping output can't be patched in place, anything like that gets rebuilt from scratch
+    uint8_t full = !session->valid || session->backwardOrgs > 0;
+
+    // Swap the lines, the label counts follow what goes out and what comes in
+    for (uint32_t i = first; i < last; i++) {
+        count_line(session, &session->lines[i], -1);
+    }
+
+    for (uint32_t i = 0; i < addedCount; i++) {
+        count_line(session, &added[i], 1);
+    }
+
+    ParserResult labelResult = PARSER_OK;
+    uint32_t labelSymbol = 0;
+
+    for (uint32_t i = first; i < last && labelResult == PARSER_OK; i++) {
+        labelResult = check_line(session, &session->lines[i], &labelSymbol);
+    }
+
+    for (uint32_t i = 0; i < addedCount && labelResult == PARSER_OK; i++) {
+        labelResult = check_line(session, &added[i], &labelSymbol);
+    }
+
+    // A failed update could have left problems behind on lines we didn't touch
+    if (!session->valid) {
+        for (uint32_t i = 0; i < build->labels.count && labelResult == PARSER_OK; i++) {
+            labelResult = check_symbol(session, i);
+            labelSymbol = i;
+        }
+    }
+
+    for (uint32_t i = first; i < last; i++) {
+        SessionLine* line = &session->lines[i];
+
+        // Splitting a segment can run out of memory, a full rebuild starts from an empty image anyway
+        if (!full && image_erase(&build->image, line->bank, line->address, line->size) != IMAGE_OK) {
+            full = 1;
+        }
+
+        session->backwardOrgs -= line->backward;
+        free_line(line);
+    }
+
+    // A session without lines doesn't have the array yet, there is nothing after them to move either
+    if (session->lineCount > last) {
+        memmove(&session->lines[first + addedCount], &session->lines[last], sizeof(SessionLine) * (session->lineCount - last));
+    }
+
+    if (addedCount > 0) {
+        memcpy(&session->lines[first], added, sizeof(SessionLine) * addedCount);
+    }
+
+    free(added);
+    session->lineCount = lineCount;
+
+    for (uint32_t i = first + addedCount; i < lineCount; i++) {
+        session->lines[i].offset = (uint32_t)(session->lines[i].offset + delta);
+    }
+
+    // The prefix is already there, move the suffix into place and copy the middle in
+    if (length > end) {
+        memmove(&session->source[end], &session->source[oldLength - (length - end)], length - end);
+    }
+
+    if (end > start) {
+        memcpy(&session->source[start], &source[start], end - start);
+    }
+    session->length = length;
+
+    session->valid = 0;
+
+    if (labelResult != PARSER_OK) {
+        build->parserResult = labelResult;
+        return fail(session, BUILD_RESULT_SYNTAX_ERROR, find_symbol_line(session, labelSymbol, labelResult));
+    }
+
+    session->epoch++;
+
+    uint8_t needsFull = full;
+    if (!full && rebuild_changed(session, first, first + addedCount, &needsFull)) {
+        return 1;
+    }
+
+    if (needsFull && rebuild_all(session)) {
+        return 1;
+    }
+
+    session->valid = 1;
+    return 0;
+}
+
+void kasm_session_dispose(KasmSession* session) {
+    for (uint32_t i = 0; i < session->lineCount; i++) {
+        free_line(&session->lines[i]);
+    }
+
+    free(session->lines);
+    free(session->symbols);
+    free(session->runs);
+    free(session->source);
+
+    kasm_context_dispose(&session->build);
+
+    session->lines = NULL;
+    session->symbols = NULL;
+    session->runs = NULL;
+    session->runCount = 0;
+    session->runCapacity = 0;
+    session->source = NULL;
+    session->lineCount = 0;
+    session->length = 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "libkasm.h"
+
+// One source line as it was parsed and laid out in the last build
+typedef struct {
+    // Where it sits in the session's copy of the source, new line included
+    uint32_t offset;
+    uint32_t length;
+
+    // The arguments are owned by the line
+    Action action;
+
+    // Id + 1 of the label defined here, 0 when there is none
+    uint32_t label;
+
+    uint32_t bank;
+    uint32_t address;
+    uint32_t size;
+
+    uint8_t hasLabelReference;
+
+    // A .org that moves back, everything after it may overlap what came before
+    uint8_t backward;
+
+    // Needs encoding in the current update
+    uint8_t dirty;
+} SessionLine;
+
+// Old lines that kept their size and moved together, their bytes get moved instead of encoded again
+typedef struct {
+    uint32_t bank;
+    uint32_t start;
+    uint32_t end;
+    uint32_t target;
+} SessionRun;
+
+typedef struct {
+    uint32_t definitions;
+    uint32_t references;
+
+    // Equal to the session epoch when the label moved in the current update
+    uint32_t movedEpoch;
+} SessionSymbol;
+
+// Keeps everything a build produced around, so the next build only redoes the lines that changed
+typedef struct {
+    // Target, labels and the output image, the image holds the result of the last successful update
+    BuildContext build;
+
+    // Copy of the source the lines were parsed from, the next update is diffed against it
+    char* source;
+    uint32_t length;
+    uint32_t sourceCapacity;
+
+    SessionLine* lines;
+    uint32_t lineCount;
+    uint32_t lineCapacity;
+
+    // Indexed by label id
+    SessionSymbol* symbols;
+    uint32_t symbolCapacity;
+
+    SessionRun* runs;
+    uint32_t runCount;
+    uint32_t runCapacity;
+
+    uint32_t backwardOrgs;
+    uint32_t epoch;
+
+    // Cleared when an update failed after its lines were taken in, the next one lays out and encodes everything
+    uint8_t valid;
+} KasmSession;
+
+uint8_t kasm_session_init(KasmSession* session, BuildTarget* target);
+
+// Rebuilds the output from the new source, results and error line are reported through session->build like kasm_build
+// When the lexer or parser rejects a line the session stays on the previous source
+uint8_t kasm_session_update(KasmSession* session, const char* source, uint32_t length);
+
+void kasm_session_dispose(KasmSession* session);
@@ -0,0 +1,200 @@
+#include "source.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Plain buffer fallback for when mapping isn't possible (pipes, special files, etc)
+static SourceResult source_read(const char* path, SourceFile* source) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return SOURCE_OPEN_FAILED;
+
+	size_t capacity = 4096;
+	size_t length = 0;
+	char* data = malloc(capacity);
+
+	while (data != NULL) {
+		length += fread(&data[length], 1, capacity - length, file);
+		if (length < capacity)
+			break;
+
+		if (capacity >= SOURCE_MAX_LENGTH) {
+			free(data);
+			fclose(file);
+			return SOURCE_TOO_LARGE;
+		}
+
+		char* grown = realloc(data, capacity * 2);
+		if (grown == NULL)
+			free(data);
+
+		data = grown;
+		capacity *= 2;
+	}
+
+	if (data == NULL) {
+		fclose(file);
+		return SOURCE_ALLOC_FAILED;
+	}
+
+	if (ferror(file)) {
+		free(data);
+		fclose(file);
+		return SOURCE_READ_FAILED;
+	}
+
+	fclose(file);
+
+	source->data = data;
+	source->length = length;
+	source->mapped = 0;
+
+	return SOURCE_OK;
+}
+
+SourceResult source_open(const char* path, SourceFile* source) {
+	source->data = NULL;
+	source->length = 0;
+	source->mapped = 0;
+	source->borrowed = 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return SOURCE_OPEN_FAILED;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return source_read(path, source);
+	}
+
+	if ((unsigned long long)size.QuadPart > SOURCE_MAX_LENGTH) {
+		CloseHandle(file);
+		return SOURCE_TOO_LARGE;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (mapping == NULL)
+		return source_read(path, source);
+
+	// The view keeps the mapping alive on its own
+	const char* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (data == NULL)
+		return source_read(path, source);
+
+	source->data = data;
+	source->length = (size_t)size.QuadPart;
+	source->mapped = 1;
+
+	return SOURCE_OK;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return SOURCE_OPEN_FAILED;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+		close(fd);
+		return source_read(path, source);
+	}
+
+	if ((unsigned long long)info.st_size > SOURCE_MAX_LENGTH) {
+		close(fd);
+		return SOURCE_TOO_LARGE;
+	}
+
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return source_read(path, source);
+
+	// We only ever walk the source front to back
+	madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	source->data = data;
+	source->length = (size_t)info.st_size;
+	source->mapped = 1;
+
+	return SOURCE_OK;
+#endif
+}
+
+SourceResult source_view(const char* data, size_t length, SourceFile* source) {
+	source->data = NULL;
+	source->length = 0;
+	source->mapped = 0;
+	source->borrowed = 0;
+
+	if (length > SOURCE_MAX_LENGTH)
+		return SOURCE_TOO_LARGE;
+
+	source->data = data;
+	source->length = length;
+	source->borrowed = 1;
+
+	return SOURCE_OK;
+}
+
+void source_close(SourceFile* source) {
+	if (source->data == NULL)
+		return;
+
+	if (source->mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(source->data);
+#else
+		munmap((void*)source->data, source->length);
+#endif
+	}
+	else if (!source->borrowed) {
+		free((void*)source->data);
+	}
+
+	source->data = NULL;
+	source->length = 0;
+	source->mapped = 0;
+	source->borrowed = 0;
+}
+
+void source_release(SourceFile* source, size_t length) {
+#ifndef _WIN32
+	if (!source->mapped)
+		return;
+
+	// madvise works on whole pages, the mapping itself starts page aligned
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	length -= length % pageSize;
+
+	if (length > 0)
+		madvise((void*)source->data, length, MADV_DONTNEED);
+#else
+	// Views can't give up part of their working set, the os trims them under pressure on its own
+	(void)source;
+	(void)length;
+#endif
+}
+
+const char* source_result_message(SourceResult result) {
+	switch (result) {
+		case SOURCE_OK:             return "OK";
+		case SOURCE_OPEN_FAILED:    return "Could Not Open File";
+		case SOURCE_READ_FAILED:    return "Read Failed";
+		case SOURCE_ALLOC_FAILED:   return "Allocation Failed";
+		case SOURCE_TOO_LARGE:      return "File Too Large";
+		default:                    return "Unknown Error";
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum {
+	SOURCE_OK,
+	SOURCE_OPEN_FAILED,
+	SOURCE_READ_FAILED,
+	SOURCE_ALLOC_FAILED,
+	SOURCE_TOO_LARGE
+} SourceResult;
+
+// Read only view of a whole input, memory mapped, read into a plain buffer or handed in by the caller
+typedef struct {
+	const char* data;
+	size_t length;
+
+	uint8_t mapped;
+
+	// Caller memory from source_view, closing only forgets about it
+	uint8_t borrowed;
+} SourceFile;
+
+// Token offsets are 32 bit, so that is as big as a source can get
+#define SOURCE_MAX_LENGTH UINT32_MAX
+
+SourceResult source_open(const char* path, SourceFile* source);
+// Wraps memory that is already loaded, nothing is copied and the data has to outlive the source
+SourceResult source_view(const char* data, size_t length, SourceFile* source);
+
+void source_close(SourceFile* source);
+
+// Tells the os the first length bytes won't be read again, a mapped source can drop those pages
+// The bytes stay valid, they just get read back from the file if anything does touch them
+void source_release(SourceFile* source, size_t length);
+
+const char* source_result_message(SourceResult result);
@@ -0,0 +1,146 @@
+#include "stats.h"
+#include "parser.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double wall_now(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+// CPU time of the calling thread only, other builds in the process don't count
+static double cpu_now(void) {
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0.0;
+
+	uint64_t kernelTime = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	uint64_t userTime = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (double)(kernelTime + userTime) / 1e7;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+static uint64_t image_memory(const Image* image) {
+	uint64_t size = (uint64_t)image->capacity * sizeof(ImageSegment) + image->scratch.capacity;
+
+	// Cleared segments past count keep their buffers too
+	for (uint32_t i = 0; i < image->capacity; i++) {
+		size += image->segments[i].bytes.capacity;
+	}
+
+	return size;
+}
+
+uint64_t kasm_context_memory(const BuildContext* context) {
+	uint64_t size = arena_size(&context->arena);
+
+	size += (uint64_t)context->tokens.capacity * (sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t));
+	size += (uint64_t)context->actions.capacity * context->actions.stride;
+
+	const SymbolTable* labels = &context->labels;
+	if (labels->symbols != NULL) {
+		size += (uint64_t)labels->capacity * sizeof(Symbol) + ((uint64_t)labels->mask + 1) * sizeof(uint32_t) + arena_size(&labels->strings);
+	}
+
+	if (context->parser != NULL) {
+		size += sizeof(ParserContext) + (uint64_t)context->parser->currentArgumentCapacity * sizeof(Argument);
+	}
+
+	size += image_memory(&context->image);
+
+	if (!context->output.borrowed)
+		size += context->output.capacity;
+
+	// A source that couldn't be mapped was read into a buffer of its own
+	if (context->source.data != NULL && !context->source.mapped && !context->source.borrowed)
+		size += context->source.length;
+
+	return size;
+}
+
+void stats_begin(BuildContext* context) {
+	BuildStats* stats = context->stats;
+	memset(stats, 0, sizeof(BuildStats));
+
+	stats->stateWall = wall_now();
+	stats->stateCpu = cpu_now();
+	stats->wallState = BUILD_STATE_LOAD_FILE;
+	stats->cpuState = BUILD_STATE_LOAD_FILE;
+	stats->startMemory = kasm_context_memory(context);
+}
+
+void stats_enter(BuildContext* context, BuildState state) {
+	BuildStats* stats = context->stats;
+
+	double cpu = cpu_now();
+	stats->cpuTime[stats->cpuState] += cpu - stats->stateCpu;
+	stats->stateCpu = cpu;
+	stats->cpuState = state;
+
+	stats_step(context, state);
+}
+
+void stats_step(BuildContext* context, BuildState state) {
+	BuildStats* stats = context->stats;
+
+	double wall = wall_now();
+	stats->wallTime[stats->wallState] += wall - stats->stateWall;
+	stats->stateWall = wall;
+	stats->wallState = state;
+}
+
+void stats_end(BuildContext* context) {
+	BuildStats* stats = context->stats;
+
+	// Close off the state the build ended in
+	stats_enter(context, (BuildState)context->buildState);
+
+	for (uint32_t i = 0; i < BUILD_STATE_MAX; i++) {
+		stats->totalWallTime += stats->wallTime[i];
+		stats->totalCpuTime += stats->cpuTime[i];
+	}
+
+	stats->peakMemory = kasm_context_memory(context);
+	stats->allocatedBytes = stats->peakMemory > stats->startMemory ? stats->peakMemory - stats->startMemory : 0;
+
+	// A build that failed to load its input never got to anything of its own, what is there is from the build before
+	if (context->buildState == BUILD_STATE_LOAD_FILE)
+		return;
+
+	stats->labels = context->labels.count;
+	stats->outputSize = image_written_size(&context->image);
+
+	// Linking reads objects, there are no tokens to count
+	if (context->source.data == NULL)
+		return;
+
+	// Streamed lines were counted as they went, whatever is left in the stream is the last line
+	stats->sourceSize = context->source.length;
+	const TokenStream* tokens = &context->tokens;
+	stats->lines = context->lineOffset + token_stream_line(tokens, tokens->count, TOKEN_EOL);
+
+	if (tokens->count > 0 && tokens->types[tokens->count - 1] != TOKEN_EOL)
+		stats->lines++;
+
+	stats->tokens += tokens->count;
+	stats->actions = context->parser != NULL ? context->parser->actionCount : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "libkasm.h"
+
+// Build bookkeeping behind BuildContext.stats, the build only calls these when stats are set
+
+// Starts the clocks and remembers what the context held before the build
+void stats_begin(BuildContext* context);
+
+// The build moved on to state, wall and CPU time so far go to the state it was in
+void stats_enter(BuildContext* context, BuildState state);
+
+// Same, but only the wall clock is read, cheap enough to do on every line
+void stats_step(BuildContext* context, BuildState state);
+
+// Stops the clocks and takes the counts, call it before the tokens and labels are cleared
+void stats_end(BuildContext* context);
@@ -0,0 +1,125 @@
+#include "symbols.h"
+
+#include <string.h>
+
+static uint32_t symbol_hash(const char* name, uint16_t length) {
+	uint32_t hash = 2166136261u;
+
+	for (uint16_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// Slots are kept at most half full, so growing them is a matter of rehashing the ids
+static SymbolResult symbol_table_grow_slots(SymbolTable* table, uint32_t slotCount) {
+	uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+	if (slots == NULL)
+		return SYMBOL_ALLOC_FAILED;
+
+	uint32_t mask = slotCount - 1;
+	for (uint32_t id = 0; id < table->count; id++) {
+		uint32_t slot = table->symbols[id].hash & mask;
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+
+		slots[slot] = id + 1;
+	}
+
+	free(table->slots);
+	table->slots = slots;
+	table->mask = mask;
+
+	return SYMBOL_OK;
+}
+
+SymbolResult symbol_table_init(SymbolTable* table) {
+	memset(table, 0, sizeof(SymbolTable));
+
+	table->symbols = malloc(sizeof(Symbol) * SYMBOL_TABLE_INITIAL_CAPACITY);
+	if (table->symbols == NULL)
+		return SYMBOL_ALLOC_FAILED;
+
+	table->capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
+
+	return symbol_table_grow_slots(table, SYMBOL_TABLE_INITIAL_CAPACITY * 2);
+}
+
+SymbolResult symbol_table_intern(SymbolTable* table, const char* name, uint16_t length, uint32_t* id) {
+	uint32_t hash = symbol_hash(name, length);
+	uint32_t slot = hash & table->mask;
+
+	while (table->slots[slot] != 0) {
+		Symbol* symbol = &table->symbols[table->slots[slot] - 1];
+		if (symbol->hash == hash && symbol->length == length && memcmp(symbol->name, name, length) == 0) {
+			*id = table->slots[slot] - 1;
+			return SYMBOL_OK;
+		}
+
+		slot = (slot + 1) & table->mask;
+	}
+
+	if (table->count >= table->capacity) {
+		Symbol* symbols = realloc(table->symbols, sizeof(Symbol) * table->capacity * 2);
+		if (symbols == NULL)
+			return SYMBOL_ALLOC_FAILED;
+
+		table->symbols = symbols;
+		table->capacity *= 2;
+	}
+
+	char* interned = arena_alloc(&table->strings, (size_t)length + 1);
+	if (interned == NULL)
+		return SYMBOL_ALLOC_FAILED;
+
+	memcpy(interned, name, length);
+	interned[length] = '\0';
+
+	Symbol* symbol = &table->symbols[table->count];
+	symbol->name = interned;
+	symbol->length = length;
+	symbol->hash = hash;
+	symbol->position = 0;
+	symbol->defined = 0;
+	symbol->reference = 0;
+	symbol->fixups = NULL;
+
+	table->slots[slot] = table->count + 1;
+	*id = table->count++;
+
+	if (table->count * 2 > table->mask + 1)
+		return symbol_table_grow_slots(table, (table->mask + 1) * 2);
+
+	return SYMBOL_OK;
+}
+
+SymbolResult symbol_table_define(SymbolTable* table, const char* name, uint16_t length, uint32_t position, uint32_t* id) {
+	SymbolResult result = symbol_table_intern(table, name, length, id);
+	if (result != SYMBOL_OK)
+		return result;
+
+	Symbol* symbol = &table->symbols[*id];
+	if (symbol->defined)
+		return SYMBOL_DUPLICATE;
+
+	symbol->defined = 1;
+	symbol->position = position;
+
+	return SYMBOL_OK;
+}
+
+void symbol_table_clear(SymbolTable* table) {
+	table->count = 0;
+	memset(table->slots, 0, sizeof(uint32_t) * (table->mask + 1));
+	arena_reset(&table->strings);
+}
+
+void symbol_table_dispose(SymbolTable* table) {
+	free(table->symbols);
+	free(table->slots);
+	arena_dispose(&table->strings);
+
+	memset(table, 0, sizeof(SymbolTable));
+}
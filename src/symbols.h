@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+
+typedef struct Fixup Fixup;
+
+typedef enum {
+	SYMBOL_OK,
+	SYMBOL_ALLOC_FAILED,
+	SYMBOL_DUPLICATE,
+	SYMBOL_OUT_OF_RANGE
+} SymbolResult;
+
+// Names are interned into the table's own pool, so a symbol never points back into the source
+typedef struct {
+	const char* name;
+	uint16_t length;
+	uint32_t hash;
+
+	uint32_t position;
+	uint8_t defined;
+
+	// Line of the first reference, an undefined label is reported there
+	uint32_t reference;
+
+	// References waiting for this symbol to be defined
+	Fixup* fixups;
+} Symbol;
+
+// Symbols are addressed by a compact id, the slots hash a name to its id + 1 (0 is empty)
+typedef struct {
+	Symbol* symbols;
+	uint32_t count;
+	uint32_t capacity;
+
+	uint32_t* slots;
+	uint32_t mask;
+
+	Arena strings;
+} SymbolTable;
+
+SymbolResult symbol_table_init(SymbolTable* table);
+
+// Returns the id of the name, adding it as an undefined symbol if we haven't seen it yet
+SymbolResult symbol_table_intern(SymbolTable* table, const char* name, uint16_t length, uint32_t* id);
+
+// Same as intern but marks the symbol as defined, defining a symbol twice gives SYMBOL_DUPLICATE
+SymbolResult symbol_table_define(SymbolTable* table, const char* name, uint16_t length, uint32_t position, uint32_t* id);
+
+static inline Symbol* symbol_table_get(const SymbolTable* table, uint32_t id) {
+	return &table->symbols[id];
+}
+
+void symbol_table_clear(SymbolTable* table);
+void symbol_table_dispose(SymbolTable* table);
@@ -0,0 +1,87 @@
+#include "thread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static DWORD WINAPI thread_start(LPVOID user) {
+	Thread* thread = user;
+	thread->fn(thread->user);
+	return 0;
+}
+#else
+static void* thread_start(void* user) {
+	Thread* thread = user;
+	thread->fn(thread->user);
+	return NULL;
+}
+#endif
+
+ThreadResult thread_create(Thread* thread, ThreadFn fn, void* user) {
+	thread->fn = fn;
+	thread->user = user;
+
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+	if (thread->handle == NULL)
+		return THREAD_CREATE_FAILED;
+#else
+	if (pthread_create(&thread->handle, NULL, thread_start, thread) != 0)
+		return THREAD_CREATE_FAILED;
+#endif
+
+	return THREAD_OK;
+}
+
+void thread_join(Thread* thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+}
+
+void mutex_init(Mutex* mutex) {
+#ifdef _WIN32
+	InitializeCriticalSection(&mutex->lock);
+#else
+	pthread_mutex_init(&mutex->lock, NULL);
+#endif
+}
+
+void mutex_lock(Mutex* mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->lock);
+#else
+	pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void mutex_unlock(Mutex* mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->lock);
+#else
+	pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+void mutex_dispose(Mutex* mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(&mutex->lock);
+#else
+	pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+uint32_t thread_cpu_count(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef enum {
+	THREAD_OK,
+	THREAD_CREATE_FAILED
+} ThreadResult;
+
+typedef void(*ThreadFn)(void* user);
+
+// The thread reads fn and user from here, so it has to stay put until thread_join
+typedef struct {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+
+	ThreadFn fn;
+	void* user;
+} Thread;
+
+typedef struct {
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t lock;
+#endif
+} Mutex;
+
+ThreadResult thread_create(Thread* thread, ThreadFn fn, void* user);
+void thread_join(Thread* thread);
+
+void mutex_init(Mutex* mutex);
+void mutex_lock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+void mutex_dispose(Mutex* mutex);
+
+// Number of cores we can run on, never less than 1
+uint32_t thread_cpu_count(void);
@@ -0,0 +1,92 @@
+#include "tokens.h"
+
+#include <string.h>
+
+TokenStreamResult token_stream_reserve(TokenStream* stream, uint32_t capacity) {
+	if (capacity <= stream->capacity)
+		return TOKEN_STREAM_OK;
+
+	uint8_t* types = realloc(stream->types, capacity * sizeof(uint8_t));
+	if (types == NULL)
+		return TOKEN_STREAM_ALLOC_FAILED;
+	stream->types = types;
+
+	uint32_t* offsets = realloc(stream->offsets, capacity * sizeof(uint32_t));
+	if (offsets == NULL)
+		return TOKEN_STREAM_ALLOC_FAILED;
+	stream->offsets = offsets;
+
+	uint16_t* lengths = realloc(stream->lengths, capacity * sizeof(uint16_t));
+	if (lengths == NULL)
+		return TOKEN_STREAM_ALLOC_FAILED;
+	stream->lengths = lengths;
+
+	stream->capacity = capacity;
+	return TOKEN_STREAM_OK;
+}
+
+static TokenStreamResult token_stream_grow(TokenStream* stream) {
+	return token_stream_reserve(stream, stream->capacity ? stream->capacity * 2 : TOKEN_STREAM_INITIAL_CAPACITY);
+}
+
+TokenStreamResult token_stream_init(TokenStream* stream) {
+	memset(stream, 0, sizeof(TokenStream));
+
+	return token_stream_grow(stream);
+}
+
+TokenStreamResult token_stream_push(TokenStream* stream, uint8_t type, uint32_t offset, uint16_t length) {
+	if (stream->count >= stream->capacity) {
+		if (token_stream_grow(stream) != TOKEN_STREAM_OK)
+			return TOKEN_STREAM_ALLOC_FAILED;
+	}
+
+	stream->types[stream->count] = type;
+	stream->offsets[stream->count] = offset;
+	stream->lengths[stream->count] = length;
+	stream->count++;
+
+	return TOKEN_STREAM_OK;
+}
+
+TokenStreamResult token_stream_append(TokenStream* stream, const TokenStream* other) {
+	if (other->count > UINT32_MAX - stream->count)
+		return TOKEN_STREAM_OUT_OF_RANGE;
+
+	uint32_t count = stream->count + other->count;
+	if (count > stream->capacity) {
+		// Go straight to the final size, appends are usually done in a row
+		if (token_stream_reserve(stream, count) != TOKEN_STREAM_OK)
+			return TOKEN_STREAM_ALLOC_FAILED;
+	}
+
+	memcpy(&stream->types[stream->count], other->types, other->count * sizeof(uint8_t));
+	memcpy(&stream->offsets[stream->count], other->offsets, other->count * sizeof(uint32_t));
+	memcpy(&stream->lengths[stream->count], other->lengths, other->count * sizeof(uint16_t));
+	stream->count = count;
+
+	return TOKEN_STREAM_OK;
+}
+
+void token_stream_clear(TokenStream* stream) {
+	stream->count = 0;
+}
+
+void token_stream_dispose(TokenStream* stream) {
+	free(stream->types);
+	free(stream->offsets);
+	free(stream->lengths);
+
+	memset(stream, 0, sizeof(TokenStream));
+}
+
+uint32_t token_stream_line(const TokenStream* stream, uint32_t index, uint8_t eolType) {
+	uint32_t line = 0;
+
+	for (uint32_t i = 0; i < index && i < stream->count; i++) {
+		if (stream->types[i] == eolType)
+			line++;
+	}
+
+	return line;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TOKEN_STREAM_INITIAL_CAPACITY 256
+#define TOKEN_MAX_LENGTH UINT16_MAX
+
+typedef enum {
+	TOKEN_STREAM_OK,
+	TOKEN_STREAM_ALLOC_FAILED,
+	TOKEN_STREAM_OUT_OF_RANGE
+} TokenStreamResult;
+
+// Packed token storage, token i is described by types[i], offsets[i] and lengths[i]
+// Tokens are spans into the source they were lexed from, the text itself is never copied
+typedef struct {
+	uint8_t* types;
+	uint32_t* offsets;
+	uint16_t* lengths;
+
+	uint32_t count;
+	uint32_t capacity;
+
+	const char* source;
+} TokenStream;
+
+TokenStreamResult token_stream_init(TokenStream* stream);
+TokenStreamResult token_stream_push(TokenStream* stream, uint8_t type, uint32_t offset, uint16_t length);
+TokenStreamResult token_stream_reserve(TokenStream* stream, uint32_t capacity);
+
+// Copies the tokens of other onto the end of stream, both have to be spans into the same source
+TokenStreamResult token_stream_append(TokenStream* stream, const TokenStream* other);
+void token_stream_clear(TokenStream* stream);
+void token_stream_dispose(TokenStream* stream);
+
+static inline const char* token_stream_value(const TokenStream* stream, uint32_t index) {
+	return &stream->source[stream->offsets[index]];
+}
+
+// Lines are not stored per token, they get counted from the end of line tokens when asked for
+uint32_t token_stream_line(const TokenStream* stream, uint32_t index, uint8_t eolType);
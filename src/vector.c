@@ -0,0 +1,53 @@
+#include "vector.h"
+
+#include <string.h>
+
+void vector_init(Vector* vector, uint32_t stride) {
+	vector->data = NULL;
+	vector->count = 0;
+	vector->capacity = 0;
+	vector->stride = stride;
+}
+
+VectorResult vector_reserve(Vector* vector, uint32_t capacity) {
+	if (capacity <= vector->capacity)
+		return VECTOR_OK;
+
+	uint32_t grown = vector->capacity ? vector->capacity : VECTOR_INITIAL_CAPACITY;
+	while (grown < capacity)
+		grown = grown > UINT32_MAX / 2 ? capacity : grown * 2;
+
+	if ((uint64_t)grown * vector->stride > SIZE_MAX)
+		return VECTOR_ALLOC_FAILED;
+
+	uint8_t* data = realloc(vector->data, (size_t)grown * vector->stride);
+	if (data == NULL)
+		return VECTOR_ALLOC_FAILED;
+
+	vector->data = data;
+	vector->capacity = grown;
+
+	return VECTOR_OK;
+}
+
+VectorResult vector_push(Vector* vector, const void* value) {
+	if (vector->count == vector->capacity) {
+		if (vector->count == UINT32_MAX || vector_reserve(vector, vector->count + 1) != VECTOR_OK)
+			return VECTOR_ALLOC_FAILED;
+	}
+
+	memcpy(vector_at(vector, vector->count++), value, vector->stride);
+	return VECTOR_OK;
+}
+
+void vector_clear(Vector* vector) {
+	vector->count = 0;
+}
+
+void vector_dispose(Vector* vector) {
+	free(vector->data);
+
+	vector->data = NULL;
+	vector->count = 0;
+	vector->capacity = 0;
+}
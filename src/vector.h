@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#define VECTOR_INITIAL_CAPACITY 32
+
+typedef enum {
+	VECTOR_OK,
+	VECTOR_ALLOC_FAILED
+} VectorResult;
+
+// Growable array of fixed size elements, stored inline one after the other
+// A zero initialized vector is empty and valid once vector_init gave it an element size
+typedef struct {
+	uint8_t* data;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t stride;
+} Vector;
+
+// Doesn't allocate, the first push or reserve does
+void vector_init(Vector* vector, uint32_t stride);
+
+VectorResult vector_reserve(Vector* vector, uint32_t capacity);
+
+// Copies stride bytes of value onto the end
+VectorResult vector_push(Vector* vector, const void* value);
+
+// Empties the vector but keeps its capacity
+void vector_clear(Vector* vector);
+void vector_dispose(Vector* vector);
+
+static inline void* vector_at(const Vector* vector, uint32_t index) {
+	return &vector->data[(size_t)index * vector->stride];
+}
+
+#define VECTOR_AT(vector, type, index) ((type*)vector_at((vector), (index)))
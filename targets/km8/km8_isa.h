@@ -0,0 +1,113 @@
+#pragma once
+
+#include "libkasm.h"
+
+// The km8 instruction set, every table of the target is expanded from the lists below
+// km8.c gets the OpcodeDefs from here, targets/tablegen.c runs over the same ones to generate the lookup tables
+
+#define TARGET_NAME     "km8"
+#define VERSION         "v0.1.0"
+#define OPCODE_COUNT    256
+
+#define IMMEDIATE_SIZE  1
+#define REGISTER_SIZE   1
+#define ADDRESS_SIZE    2
+#define REGISTER_COUNT  14
+
+// Operand lists shared between opcodes, X(name, count, operands...)
+#define KM8_OPERANDS(X) \
+    X(none,    0, OPERAND_NIL) \
+    X(reg_mem, 2, OPERAND_REG, OPERAND_MEM) \
+    X(reg_imm, 2, OPERAND_REG, OPERAND_IMM) \
+    X(reg_reg, 2, OPERAND_REG, OPERAND_REG) \
+    X(reg,     1, OPERAND_REG) \
+    X(mem,     1, OPERAND_MEM)
+
+// X(opcode, mnemonic, operands)
+#define KM8_OPCODES(X) \
+    /* Data */ \
+    X(0x00, nop,  none) \
+    X(0x01, ldr,  reg_mem) \
+    X(0x02, ldr,  reg_imm) \
+    X(0x03, str,  reg_mem) \
+    X(0x04, mov,  reg_reg) \
+    X(0x05, swp,  reg_reg) \
+    X(0x06, push, reg) \
+    X(0x07, pop,  reg) \
+    X(0x08, clr,  reg) \
+    \
+    /* Arithmetic */ \
+    X(0x10, add,  reg_reg) \
+    X(0x11, add,  reg_imm) \
+    X(0x12, adc,  reg_reg) \
+    X(0x13, adc,  reg_imm) \
+    X(0x14, inc,  reg) \
+    X(0x15, sub,  reg_reg) \
+    X(0x16, sub,  reg_imm) \
+    X(0x17, sbc,  reg_reg) \
+    X(0x18, sbc,  reg_imm) \
+    X(0x19, dec,  reg) \
+    X(0x1A, cmp,  reg_reg) \
+    X(0x1B, cmp,  reg_imm) \
+    \
+    /* Bitwise */ \
+    X(0x20, add,  reg_reg) \
+    X(0x21, add,  reg_reg) \
+    X(0x22, or,   reg_reg) \
+    X(0x23, or,   reg_reg) \
+    X(0x24, xor,  reg_reg) \
+    X(0x25, xor,  reg_reg) \
+    X(0x26, not,  reg_reg) \
+    X(0x27, shl,  reg_reg) \
+    X(0x28, shr,  reg_reg) \
+    X(0x29, rol,  reg_reg) \
+    X(0x2A, ror,  reg_reg) \
+    X(0x2B, tst,  reg_reg) \
+    X(0x2C, tst,  reg_reg) \
+    \
+    /* Conditionals */ \
+    X(0x30, jmp,  mem) \
+    X(0x31, jmp,  reg) \
+    X(0x32, jz,   mem) \
+    X(0x33, jz,   reg) \
+    X(0x34, jnz,  mem) \
+    X(0x35, jnz,  reg) \
+    X(0x36, jc,   mem) \
+    X(0x37, jc,   reg) \
+    X(0x38, jnc,  mem) \
+    X(0x39, jnc,  reg) \
+    X(0x3A, jn,   mem) \
+    X(0x3B, jn,   reg) \
+    X(0x3C, jnn,  mem) \
+    X(0x3D, jnn,  reg) \
+    X(0x3E, jv,   mem) \
+    X(0x3F, jv,   reg) \
+    X(0x40, jnv,  mem) \
+    X(0x41, jnv,  reg) \
+    X(0x42, call, mem) \
+    X(0x43, call, reg) \
+    X(0x44, ret,  none) \
+    X(0x45, hlt,  none)
+
+
+#define KM8_OPERAND_LIST(name, count, ...) \
+    static const OperandType op_##name[] = { __VA_ARGS__ }; \
+    enum { op_##name##_count = count };
+
+KM8_OPERANDS(KM8_OPERAND_LIST)
+
+#define KM8_OPCODE_DEF(code, name, list) \
+    [code] = { .mnemonic = #name, .operandCount = op_##list##_count, .operands = op_##list },
+
+static const OpcodeDef gOpcodes[OPCODE_COUNT] = {
+    KM8_OPCODES(KM8_OPCODE_DEF)
+};
+
+static inline uint16_t get_operand_size(OperandType operand) {
+    switch(operand) {
+        case OPERAND_IMM: return IMMEDIATE_SIZE;
+        case OPERAND_REG: return REGISTER_SIZE;
+        case OPERAND_MEM: return ADDRESS_SIZE;
+        default:          return 0;
+    }
+}
@@ -0,0 +1,108 @@
+// Turns the ISA description of a target into static lookup tables, so registering it doesn't build anything
+// The tables come out of opcode_index_build itself, the hash and the probing can't disagree with the library's
+//
+//   Built with TABLEGEN_ISA naming the ISA header, see CMakeLists.txt
+//   Usage: <tablegen> <output header>
+#include <stdio.h>
+#include "opcode.h"
+#include TABLEGEN_ISA
+
+static const OpcodeDef* get_opcode(uint16_t index) {
+    return &gOpcodes[index];
+}
+
+static void write_entries(FILE* out, const char* name, const OpcodeTable* table) {
+    fprintf(out, "static const OpcodeIndexEntry %s[%u] = {\n", name, table->mask + 1);
+
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        const OpcodeIndexEntry* entry = &table->entries[i];
+        if (entry->mnemonic == NULL)
+            continue;
+
+        fprintf(out, "    [%u] = { \"%s\", %u, 0x%02X, 0x%08X },\n", i, entry->mnemonic, entry->length, entry->opcode, entry->signature);
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+static void write_array(FILE* out, const char* type, const char* name, const void* values, size_t size, uint16_t count) {
+    fprintf(out, "static const %s %s[%u] = {", type, name, count);
+
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t value = size == 1 ? ((const uint8_t*)values)[i] : ((const uint32_t*)values)[i];
+        fprintf(out, "%s0x%0*X,", i % 8 ? " " : "\n    ", (int)size * 2, value);
+    }
+
+    fprintf(out, "\n};\n\n");
+}
+
+static void write_index(FILE* out, const OpcodeIndex* index, uint16_t opcodeCount) {
+    fprintf(out, "// Generated from %s by targets/tablegen.c, edit the ISA instead\n", TABLEGEN_ISA);
+    fprintf(out, "#pragma once\n\n#include \"opcode.h\"\n\n");
+
+    write_entries(out, "gMnemonicEntries", &index->mnemonics);
+    write_entries(out, "gSignatureEntries", &index->signatures);
+    write_array(out, "uint8_t", "gOpcodeLengths", index->lengths, sizeof(uint8_t), opcodeCount);
+    write_array(out, "uint32_t", "gOpcodeOperands", index->operands, sizeof(uint32_t), opcodeCount);
+
+    // An empty array isn't valid C, no conflicts is a NULL pointer
+    if (index->conflictCount) {
+        fprintf(out, "static const OpcodeConflict gOpcodeConflicts[%u] = {\n", index->conflictCount);
+        for (uint16_t i = 0; i < index->conflictCount; i++) {
+            fprintf(out, "    { 0x%02X, 0x%02X },\n", index->conflicts[i].first, index->conflicts[i].second);
+        }
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "static const OpcodeIndex gOpcodeTables = {\n");
+    fprintf(out, "    .version = %u,\n", index->version);
+    fprintf(out, "    .mnemonics = { gMnemonicEntries, 0x%X },\n", index->mnemonics.mask);
+    fprintf(out, "    .signatures = { gSignatureEntries, 0x%X },\n", index->signatures.mask);
+    fprintf(out, "    .conflicts = %s,\n", index->conflictCount ? "gOpcodeConflicts" : "NULL");
+    fprintf(out, "    .conflictCount = %u,\n", index->conflictCount);
+    fprintf(out, "    .lengths = gOpcodeLengths,\n");
+    fprintf(out, "    .operands = gOpcodeOperands,\n");
+    fprintf(out, "    .operandSizes = { %u, %u, %u, %u },\n", index->operandSizes[0], index->operandSizes[1], index->operandSizes[2], index->operandSizes[3]);
+    fprintf(out, "    .opcodeSize = %u\n", index->opcodeSize);
+    fprintf(out, "};\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s <output header>\n", argv[0]);
+        return 1;
+    }
+
+    BuildTarget target = {
+        .name = TARGET_NAME,
+        .opcodeCount = OPCODE_COUNT,
+        .get_opcode = get_opcode,
+        .get_operand_size = get_operand_size
+    };
+
+    // Conflicts end up in the tables, kasm_register_target reports them like it would for a built index
+    OpcodeIndex index = { 0 };
+    TargetResult result = opcode_index_build(&target, &index);
+    if (result > TARGET_SIGNATURE_CONFLICT) {
+        printf("%s: Could not build the tables\n", TABLEGEN_ISA);
+        opcode_index_dispose(&index);
+        return 1;
+    }
+
+    FILE* out = fopen(argv[1], "w");
+    if (out == NULL) {
+        printf("Could not open %s\n", argv[1]);
+        opcode_index_dispose(&index);
+        return 1;
+    }
+
+    write_index(out, &index, target.opcodeCount);
+    opcode_index_dispose(&index);
+
+    if (fclose(out) != 0) {
+        remove(argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+// Stress test for concurrent builds, every thread builds the same source on a context of its own
+// while they all share one IncludeCache, and every image has to match the one a single thread built
+// Configure with -DKASM_TSAN=ON to have ThreadSanitizer watch all of it
+//
+//   Usage: concurrent_builds <scratch directory> [threads] [iterations]
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/libkasm.h"
+#include "../src/include.h"
+#include "../src/thread.h"
+
+// Compiled in from targets/km8, like the benchmark
+BuildTarget* kasm_target_register();
+
+#define STRESS_MAX_THREADS 64
+
+// Big enough for BUILD_FLAG_PARALLEL_LEX to really split the source, small enough for a bank to hold its lines
+#define STRESS_BANKS 8
+#define STRESS_LINES_PER_BANK 4000
+
+// Every build mode a context can run in, the threads cycle through them
+static const uint8_t gFlags[] = {
+    0,
+    BUILD_FLAG_SINGLE_PASS,
+    BUILD_FLAG_STREAM,
+    BUILD_FLAG_PARALLEL_LEX
+};
+
+typedef struct {
+    BuildTarget* target;
+    IncludeCache* includes;
+
+    const char* source;
+    uint32_t length;
+
+    const uint8_t* expected;
+    uint32_t expectedLength;
+
+    // Rewritten with the same bytes now and then, so the cache refreshes entries other threads are using
+    const char* headerPath;
+    const char* header;
+
+    uint32_t iterations;
+} Stress;
+
+typedef struct {
+    Thread thread;
+    Stress* stress;
+    uint32_t index;
+
+    uint32_t failed;
+    uint32_t mismatched;
+} Worker;
+
+// Goes through a temporary file, a build that opens the header halfway through a rewrite still sees all of it
+static uint8_t write_file(const char* path, const char* text) {
+    char temporary[520];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE* file = fopen(temporary, "wb");
+    if (file == NULL)
+        return 1;
+
+    size_t length = strlen(text);
+    uint8_t failed = fwrite(text, 1, length, file) != length;
+
+    if (fclose(file) != 0 || failed) {
+        remove(temporary);
+        return 1;
+    }
+
+    return rename(temporary, path) != 0;
+}
+
+static uint8_t append(ByteBuffer* buffer, const char* format, ...) {
+    char line[256];
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (length < 0 || length >= (int)sizeof(line))
+        return 1;
+
+    return byte_buffer_write(buffer, buffer->length, line, (uint32_t)length) != BYTE_BUFFER_OK;
+}
+
+// Labels both ways, data and includes on every bank, so fixups, the image and the cache all get a workout
+static uint8_t generate_source(ByteBuffer* source, const char* headerPath) {
+    uint32_t seed = 0x9E3779B9u;
+
+    for (uint32_t bank = 0; bank < STRESS_BANKS; bank++) {
+        if (append(source, ".bank $0x%X\n.org $0x0\n@b%u:\n.include \"%s\"\n", bank, bank, headerPath))
+            return 1;
+
+        for (uint32_t i = 0; i < STRESS_LINES_PER_BANK; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            uint8_t failed;
+
+            switch (seed % 6) {
+                case 0:  failed = append(source, "jz @b%u\n", bank); break;
+                case 1:  failed = append(source, "jmp @l%u\n", bank * STRESS_LINES_PER_BANK + (seed >> 8) % STRESS_LINES_PER_BANK); break;
+                case 2:  failed = append(source, ".db #0x%02X, #%u, @l%u\n", seed >> 24, (seed >> 8) & 0xFF, bank * STRESS_LINES_PER_BANK); break;
+                case 3:  failed = append(source, "ldr r%u, $0x%04X\n", (seed >> 4) % 12, (seed >> 12) & 0xFFFF); break;
+                case 4:  failed = append(source, "add r%u, #%u\t; counter\n", (seed >> 4) % 12, (seed >> 8) & 0xFF); break;
+                default: failed = append(source, "mov r%u, r%u\n", (seed >> 4) % 12, (seed >> 8) % 12); break;
+            }
+
+            if (failed)
+                return 1;
+        }
+
+        // Forward references, they all wait on a fixup until down here
+        for (uint32_t i = 0; i < STRESS_LINES_PER_BANK; i++) {
+            if (append(source, "@l%u:\n", bank * STRESS_LINES_PER_BANK + i))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void worker_main(void* user) {
+    Worker* worker = user;
+    Stress* stress = worker->stress;
+
+    BuildContext context = { 0 };
+    context.target = stress->target;
+    context.includes = stress->includes;
+
+    for (uint32_t i = 0; i < stress->iterations; i++) {
+        context.flags = gFlags[(worker->index + i) % (sizeof(gFlags) / sizeof(gFlags[0]))];
+
+        if (worker->index == 0 && i % 4 == 0 && write_file(stress->headerPath, stress->header)) {
+            worker->failed++;
+            continue;
+        }
+
+        if (kasm_build_buffer(stress->source, stress->length, &context)) {
+            worker->failed++;
+            continue;
+        }
+
+        if (context.output.length != stress->expectedLength || memcmp(context.output.data, stress->expected, stress->expectedLength) != 0)
+            worker->mismatched++;
+    }
+
+    kasm_context_dispose(&context);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: concurrent_builds <scratch directory> [threads] [iterations]\n");
+        return 1;
+    }
+
+    uint32_t threadCount = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 8;
+    uint32_t iterations = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : 4;
+
+    if (threadCount == 0 || threadCount > STRESS_MAX_THREADS) {
+        printf("Threads has to be between 1 and %u\n", STRESS_MAX_THREADS);
+        return 1;
+    }
+
+    BuildTarget* target = kasm_target_register();
+    if (kasm_register_target(target) > TARGET_SIGNATURE_CONFLICT) {
+        printf("Could not register the km8 target\n");
+        return 1;
+    }
+
+    // Includes are resolved against the working directory for sources from memory, so the header gets an absolute path
+    char headerPath[512];
+    snprintf(headerPath, sizeof(headerPath), "%s/concurrent_builds_header.kasm", argv[1]);
+
+    static const char* header = "nop\nldr r0, #0x42\n.db #1, #2, #3, #4\n";
+    if (write_file(headerPath, header)) {
+        printf("Could not write %s\n", headerPath);
+        return 1;
+    }
+
+    ByteBuffer source = { 0 };
+    if (generate_source(&source, headerPath)) {
+        printf("Could not generate the source\n");
+        return 1;
+    }
+
+    IncludeCache includes;
+    include_cache_init(&includes);
+
+    // The reference comes from a context and cache of its own, before any other thread exists
+    BuildContext reference = { 0 };
+    reference.target = target;
+
+    if (kasm_build_buffer((const char*)source.data, source.length, &reference)) {
+        printf("Reference build failed: %s on line %u\n", get_build_result_msg(reference.assemblerResult), reference.errorLine + 1);
+        return 1;
+    }
+
+    Stress stress = {
+        .target = target,
+        .includes = &includes,
+        .source = (const char*)source.data,
+        .length = source.length,
+        .expected = reference.output.data,
+        .expectedLength = reference.output.length,
+        .headerPath = headerPath,
+        .header = header,
+        .iterations = iterations
+    };
+
+    Worker workers[STRESS_MAX_THREADS] = { 0 };
+    uint32_t started = 0;
+
+    for (; started < threadCount; started++) {
+        workers[started].stress = &stress;
+        workers[started].index = started;
+
+        if (thread_create(&workers[started].thread, worker_main, &workers[started]) != THREAD_OK)
+            break;
+    }
+
+    uint32_t failed = started < threadCount;
+    uint32_t mismatched = 0;
+
+    for (uint32_t i = 0; i < started; i++) {
+        thread_join(&workers[i].thread);
+
+        failed += workers[i].failed;
+        mismatched += workers[i].mismatched;
+    }
+
+    printf("%u threads, %u builds each of %u bytes into %u bytes: %u failed, %u mismatched, %llu include hits, %llu misses\n",
+        started, iterations, source.length, reference.output.length, failed, mismatched,
+        (unsigned long long)includes.hits, (unsigned long long)includes.misses);
+
+    kasm_context_dispose(&reference);
+    include_cache_dispose(&includes);
+    byte_buffer_dispose(&source);
+    kasm_unregister_target(target);
+    remove(headerPath);
+
+    return failed || mismatched;
+}
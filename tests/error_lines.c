@@ -0,0 +1,102 @@
+// Every build mode has to reject a broken source with the same result on the same line
+// Two pass builds find some errors in kasm_assemble, long after the parser moved past the line
+//
+//   Usage: error_lines <scratch directory>
+#include <stdio.h>
+#include <string.h>
+#include "../src/libkasm.h"
+
+// Compiled in from targets/km8
+BuildTarget* kasm_target_register();
+
+typedef struct {
+    const char* source;
+    BuildResult result;
+
+    // Counted from 1, like the CLI prints it
+    uint32_t line;
+} ErrorCase;
+
+static const ErrorCase gCases[] = {
+    { "nop\nnop\n.db r1\nnop\n",            BUILD_RESULT_ASSEMBLY_ERROR,    3 },
+    { "nop\njmp @nope\n",                   BUILD_RESULT_SYNTAX_ERROR,      2 },
+    { "jmp @nope\nnop\njz @nope\n",         BUILD_RESULT_SYNTAX_ERROR,      1 },
+    { "nop\n\nldr r0, #0x100\n",            BUILD_RESULT_SYNTAX_ERROR,      3 },
+    { "nop\nnop\n.org #0\nnop\n",           BUILD_RESULT_ASSEMBLY_ERROR,    4 },
+    { "nop\n.db \"abc\"\nhlt\n",            BUILD_RESULT_SYNTAX_ERROR,      2 },
+    { ".org \"x\"\n",                       BUILD_RESULT_SYNTAX_ERROR,      1 },
+    { "nop\nnop",                           BUILD_RESULT_SUCCESS,           0 },
+};
+
+static const uint8_t gFlags[] = {
+    0,
+    BUILD_FLAG_SINGLE_PASS,
+    BUILD_FLAG_STREAM
+};
+
+static uint8_t write_file(const char* path, const char* text) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        return 1;
+
+    size_t length = strlen(text);
+    uint8_t failed = fwrite(text, 1, length, file) != length;
+
+    return fclose(file) != 0 || failed;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: error_lines <scratch directory>\n");
+        return 1;
+    }
+
+    BuildTarget* target = kasm_target_register();
+    if (kasm_register_target(target) > TARGET_SIGNATURE_CONFLICT) {
+        printf("Could not register the km8 target\n");
+        return 1;
+    }
+
+    char sourcePath[512];
+    char outputPath[512];
+    snprintf(sourcePath, sizeof(sourcePath), "%s/error_lines.kasm", argv[1]);
+    snprintf(outputPath, sizeof(outputPath), "%s/error_lines.bin", argv[1]);
+
+    uint32_t caseCount = sizeof(gCases) / sizeof(gCases[0]);
+    uint32_t flagCount = sizeof(gFlags) / sizeof(gFlags[0]);
+    uint32_t failed = 0;
+
+    for (uint32_t i = 0; i < caseCount; i++) {
+        const ErrorCase* errorCase = &gCases[i];
+
+        if (write_file(sourcePath, errorCase->source)) {
+            printf("Could not write %s\n", sourcePath);
+            return 1;
+        }
+
+        for (uint32_t j = 0; j < flagCount; j++) {
+            BuildContext context = { 0 };
+            context.target = target;
+            context.flags = gFlags[j];
+
+            kasm_build(sourcePath, outputPath, &context);
+
+            uint32_t line = context.assemblerResult != BUILD_RESULT_SUCCESS ? context.errorLine + 1 : 0;
+            if (context.assemblerResult != errorCase->result || line != errorCase->line) {
+                printf("Case %u with flags %u: result %u on line %u, expected %u on line %u\n",
+                    i, gFlags[j], context.assemblerResult, line, errorCase->result, errorCase->line);
+                failed++;
+            }
+
+            kasm_context_dispose(&context);
+        }
+    }
+
+    printf("%u of %u builds reported the wrong error\n", failed, caseCount * flagCount);
+
+    kasm_unregister_target(target);
+    remove(sourcePath);
+    remove(outputPath);
+
+    return failed != 0;
+}